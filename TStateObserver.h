@@ -29,6 +29,18 @@ class TStateObserver : public TEvolObserver
 
     void virtual
     measure(const Args& args = Global::args());
+
+    //Total discarded weight the evolver passed as "TruncErr"
+    //to measure since the last reset, and the number of steps
+    //which passed it
+    Real
+    truncErr() const { return truncerr_; }
+
+    int
+    truncErrSteps() const { return nterr_; }
+
+    void
+    resetTruncErr() { truncerr_ = 0; nterr_ = 0; }
     
     private:
 
@@ -38,6 +50,8 @@ class TStateObserver : public TEvolObserver
 
     const MPST& psi_;
     bool show_maxm_;
+    Real truncerr_ = 0;
+    int nterr_ = 0;
 
     //
     /////////////
@@ -60,6 +74,11 @@ void inline TStateObserver<Tensor>::
 measure(const Args& args)
     {
     const auto t = args.getReal("Time");
+    if(args.defined("TruncErr"))
+        {
+        truncerr_ += args.getReal("TruncErr");
+        ++nterr_;
+        }
     if(show_maxm_)
         {
         const auto ttotal = args.getReal("TotalTime");
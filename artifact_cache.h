@@ -0,0 +1,295 @@
+#ifndef __ARTIFACT_CACHE_H
+#define __ARTIFACT_CACHE_H
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <unistd.h>
+#include "itensor/all.h"
+#include "trotter.h"
+#include "gatecache.h"
+
+namespace itensor {
+
+//
+// On-disk cache of objects which are expensive to build at startup,
+// such as the Hamiltonian MPO, H^2, the S^2 MPOs, gate lists and
+// exp(-tau H) MPOs.
+//
+// Each object is described by a string holding everything it depends
+// on (lattice, couplings, tau, truncation settings, ...) and is stored
+// in the file <dir>/<hash of description>.bin, so jobs of a parameter
+// scan sharing some of their inputs also share the corresponding files.
+// The description is also stored in the file and checked when reading.
+// Files are written to a temporary file which is then renamed, so a
+// file is never read while incomplete.
+//
+// Objects built on a site set (MPOs and gates) are only valid with the
+// same site indices, so their keys also include a hash of the ids of
+// the site indices. An object built by another job on different sites
+// is then never loaded, it is just built again. To share these objects
+// between jobs, the site set itself should be taken from the cache too.
+// Jobs which start at the same time on an empty cache may each make
+// their own site set, and then simply do not share objects built on it.
+// So several jobs may use the same cache directory at the same time.
+//
+// Gate lists are stored with each distinct gate tensor written once
+// (see gates below), so a list made with a GateCache keeps sharing its
+// storage when read back.
+//
+// If dir is empty the cache is disabled and objects are always built.
+//
+class ArtifactCache
+    {
+    public:
+
+    ArtifactCache(std::string const& dir = "")
+      : dir_(dir)
+        { }
+
+    bool
+    enabled() const { return !dir_.empty(); }
+
+    template<class SiteSetT, class Builder>
+    SiteSetT
+    sites(std::string const& desc,
+          Builder&& build);
+
+    template<class MPOT, class Builder>
+    MPOT
+    mpo(std::string const& desc,
+        SiteSet const& sites,
+        Builder&& build);
+
+    template<class Tensor, class Builder>
+    GateList<Tensor>
+    gates(std::string const& desc,
+          SiteSet const& sites,
+          Builder&& build);
+
+    std::string
+    filename(std::string const& desc) const;
+
+    //Description desc of an object built on sites, extended
+    //by the hash of the ids of the site indices
+    std::string
+    key(std::string const& desc,
+        SiteSet const& sites) const;
+
+    private:
+
+    //Call read(istream) if desc is in the cache and return true
+    template<class Reader>
+    bool
+    load(std::string const& desc,
+         Reader&& read) const;
+
+    //Store the object written by write(ostream) under desc
+    template<class Writer>
+    void
+    store(std::string const& desc,
+          Writer&& write) const;
+
+    std::string dir_;
+    };
+
+
+//
+// Implementations
+//
+
+//
+// 64 bit FNV-1a hash
+//
+inline uint64_t
+fnvHash(void const* data,
+        size_t n,
+        uint64_t h = 14695981039346656037ULL)
+    {
+    auto p = static_cast<unsigned char const*>(data);
+    for(size_t i = 0; i < n; ++i)
+        {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+        }
+    return h;
+    }
+
+inline std::string ArtifactCache::
+filename(std::string const& desc) const
+    {
+    return format("%s/%016x.bin",dir_,fnvHash(desc.data(),desc.size()));
+    }
+
+inline std::string ArtifactCache::
+key(std::string const& desc,
+    SiteSet const& sites) const
+    {
+    auto h = fnvHash(nullptr,0);
+    for(int j = 1; j <= sites.N(); ++j)
+        {
+        uint64_t id = sites(j).id();
+        h = fnvHash(&id,sizeof(id),h);
+        }
+    return format("%s sites=%016x",desc,h);
+    }
+
+template<class Reader>
+bool ArtifactCache::
+load(std::string const& desc,
+     Reader&& read) const
+    {
+    if(!enabled()) return false;
+    auto fname = filename(desc);
+    std::ifstream s(fname,std::ios::binary);
+    if(!s) return false;
+
+    std::string stored;
+    std::getline(s,stored);
+    if(stored != desc)
+        {
+        printfln("Cache file %s holds a different object, not using it",fname);
+        return false;
+        }
+    read(s);
+    if(!s) Error("Error reading cache file " + fname);
+    printfln("Read %s from cache",desc);
+    return true;
+    }
+
+template<class Writer>
+void ArtifactCache::
+store(std::string const& desc,
+      Writer&& write) const
+    {
+    if(!enabled()) return;
+    auto fname = filename(desc);
+    auto tmpname = format("%s.tmp%d",fname,getpid());
+    std::ofstream s(tmpname,std::ios::binary);
+    if(!s)
+        {
+        printfln("Could not write cache file %s",tmpname);
+        return;
+        }
+    s << desc << "\n";
+    write(s);
+    s.close();
+    std::rename(tmpname.c_str(),fname.c_str());
+    }
+
+template<class SiteSetT, class Builder>
+SiteSetT ArtifactCache::
+sites(std::string const& desc,
+      Builder&& build)
+    {
+    auto res = SiteSetT();
+    if(load(desc,[&res](std::istream& s) { res.read(s); })) return res;
+    res = build();
+    store(desc,[&res](std::ostream& s) { res.write(s); });
+    return res;
+    }
+
+template<class MPOT, class Builder>
+MPOT ArtifactCache::
+mpo(std::string const& desc,
+    SiteSet const& sites,
+    Builder&& build)
+    {
+    auto k = key(desc,sites);
+    auto res = MPOT(sites);
+    if(load(k,[&res](std::istream& s) { res.read(s); })) return res;
+    res = build();
+    store(k,[&res](std::ostream& s) { res.write(s); });
+    return res;
+    }
+
+//
+// A gate list is stored as the distinct gate tensors, each moved
+// to sites 1,2, followed by each gate's sites, type and the number
+// of its tensor. Gates are the same tensor if they share storage,
+// as the gates made by a GateCache do. When read back every gate
+// is made by moving its tensor to its sites, which shares storage
+// again, so the memory used is that of the distinct tensors only.
+//
+template<class Tensor, class Builder>
+GateList<Tensor> ArtifactCache::
+gates(std::string const& desc,
+      SiteSet const& sites,
+      Builder&& build)
+    {
+    using GateT = BondGate<Tensor>;
+
+    auto k = key("gatelist "+desc,sites);
+    auto res = GateList<Tensor>();
+    auto reader = [&res,&sites](std::istream& s)
+        {
+        auto ndistinct = read<int>(s);
+        auto distinct = std::vector<Tensor>(ndistinct);
+        for(auto& T : distinct) read(s,T);
+        auto ngates = read<int>(s);
+        for(int n = 0; n < ngates; ++n)
+            {
+            auto i1 = read<int>(s);
+            auto i2 = read<int>(s);
+            auto type = read<int>(s);
+            if(type == int(GateT::Swap))
+                {
+                res.push_back(GateT(sites,i1,i2));
+                }
+            else
+                {
+                auto& T = distinct.at(read<int>(s));
+                res.push_back(GateT(sites,i1,i2,moveSites(T,sites,1,2,i1,i2)));
+                }
+            }
+        };
+    if(load(k,reader)) return res;
+
+    res = build();
+    store(k,[&res,&sites](std::ostream& s)
+        {
+        //Number of the distinct tensor of each gate
+        auto distinct = std::vector<Tensor>();
+        auto num = std::vector<int>();
+        std::map<void const*,std::vector<int>> by_store;
+        for(auto& g : res)
+            {
+            if(g.type() == GateT::Swap)
+                {
+                num.push_back(-1);
+                continue;
+                }
+            auto T = moveSites(g.gate(),sites,g.i1(),g.i2(),1,2);
+            auto& cands = by_store[g.gate().store().get()];
+            int found = -1;
+            for(auto c : cands)
+                {
+                if(norm(distinct.at(c)-T) < 1E-14*norm(T)) { found = c; break; }
+                }
+            if(found < 0)
+                {
+                found = distinct.size();
+                distinct.push_back(T);
+                cands.push_back(found);
+                }
+            num.push_back(found);
+            }
+
+        write(s,int(distinct.size()));
+        for(auto& T : distinct) write(s,T);
+        write(s,int(res.size()));
+        for(auto n : range(res))
+            {
+            auto& g = res.at(n);
+            write(s,g.i1());
+            write(s,g.i2());
+            write(s,int(g.type()));
+            if(g.type() != GateT::Swap) write(s,num.at(n));
+            }
+        });
+    return res;
+    }
+
+} //namespace itensor
+
+#endif //__ARTIFACT_CACHE_H
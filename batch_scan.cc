@@ -0,0 +1,326 @@
+#include <functional>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "itensor/all.h"
+#include "basis/rotatexz.h"
+#include "heisops.h"
+#include "collapse.h"
+#include "S2.h"
+#include "trotter.h"
+#include "gate_kernel.h"
+#include "TStateObserver.h"
+#include "metts.h"
+#include "inputlist.h"
+#include "artifact_cache.h"
+#include "mempool.h"
+#include "mpo_tevol.h"
+
+using namespace std;
+using namespace itensor;
+
+//
+// Runs METTS for every point of a parameter scan of the
+// triangular lattice XXZ model in one job.
+//
+// What does not depend on the couplings (site set, lattice, basis,
+// S^2 MPOs, gate cache) is made once per Ny in the parent process.
+// H, H^2 and the gates of each point are made in the parent too,
+// just before the point is started, so that the gate cache is shared
+// by all points: only the gate exponentials of bond Hamiltonians not
+// seen before (for example with a new field hz) are computed.
+//
+// Each point then runs in a child process forked from the parent,
+// which sees all of these objects without copying them. At most
+// nworkers points run at the same time. Each child writes its
+// output to its own log and result files.
+//
+
+//
+// Objects shared by all points with the same Ny
+//
+struct ScanModel
+    {
+    SpinHalf sites;
+    std::vector<LatticeBond> lattice;
+    BasisPtr<IQTensor> basis;
+    IQMPO S2,
+          Sxy2,
+          Sz2;
+    GateCache<IQTensor> gate_cache;
+    };
+
+struct ScanPoint
+    {
+    int num = 0;
+    int Ny = 0;
+    Real hz = 0,
+         Jz = 1,
+         Jxy = 1,
+         beta = 1;
+    };
+
+int
+main(int argc, char* argv[])
+    {
+    if(argc < 2)
+        {
+        printfln("Usage: %s <input_file>", argv[0]);
+        return 0;
+        }
+    println("Process id is ",getpid());
+
+    auto infile = InputFile(argv[1]);
+    println(infile,"******************\n");
+    auto in = InputGroup(infile,"input");
+
+    auto Nx = in.getInt("Nx");
+    auto cutoff = in.getReal("cutoff");
+    auto nmetts = in.getInt("nmetts",50000);
+    auto maxm = in.getInt("maxm",5000);
+    auto tau = in.getReal("tau",0.1);
+    auto nwarm = in.getInt("nwarm",5);
+    auto evolver = in.getString("evolver","gates");
+    auto nworkers = in.getInt("nworkers",1);
+    auto measure_threads = in.getInt("measure_threads",1);
+    auto prefix = in.getString("scan_prefix","scan");
+    auto seed = in.getInt("seed",int(std::time(NULL)%100000));
+    auto cache_dir = in.getString("cache_dir","");
+    auto mempool = in.getYesNo("mempool",false);
+    auto pool_top_pad = in.getReal("pool_top_pad",64);
+    auto pool_max = in.getReal("pool_max",4096);
+    auto realstep = in.getYesNo("realstep",false);
+
+    //Each scanned parameter is a comma separated list,
+    //defaulting to the single value of the parameter
+    auto values = [&in](string name, Real def)
+        {
+        auto list = parseRealList(in.getString(name+"_values",""));
+        if(list.empty()) list = {in.getReal(name,def)};
+        return list;
+        };
+    auto Nys = values("Ny",0);
+    auto hzs = values("hz",0);
+    auto Jzs = values("Jz",1);
+    auto Jxys = values("Jxy",1);
+    auto betas = values("beta",1);
+
+    for(auto Ny : Nys)
+        {
+        if(Ny < 1) Error("Ny or Ny_values must be given, with every Ny at least 1");
+        }
+    if(nworkers < 1) Error("nworkers must be at least 1");
+    if(evolver != "gates" && evolver != "fast" && evolver != "mpo")
+        {
+        Error("evolver must be gates, fast or mpo");
+        }
+
+    auto points = std::vector<ScanPoint>();
+    for(auto Ny : Nys)
+    for(auto Jxy : Jxys)
+    for(auto Jz : Jzs)
+    for(auto hz : hzs)
+    for(auto beta : betas)
+        {
+        auto p = ScanPoint();
+        p.num = points.size()+1;
+        p.Ny = int(Ny);
+        p.hz = hz;
+        p.Jz = Jz;
+        p.Jxy = Jxy;
+        p.beta = beta;
+        points.push_back(p);
+        }
+    printfln("Scan of %d points on %d workers",points.size(),nworkers);
+
+    auto cache = ArtifactCache(cache_dir);
+
+    std::map<int,ScanModel> models;
+    auto model = [&](int Ny) -> ScanModel&
+        {
+        auto it = models.find(Ny);
+        if(it != models.end()) return it->second;
+
+        auto N = Nx*Ny;
+        auto sites = cache.sites<SpinHalf>(format("SpinHalf N=%d",N),[N]() { return SpinHalf(N); });
+        auto S2 = cache.mpo<IQMPO>(format("S2 N=%d",N),sites,[&sites]() { return makeS2(sites); });
+        auto Sxy2 = cache.mpo<IQMPO>(format("Sxy2 N=%d",N),sites,[&sites]() { return makeSxy2(sites); });
+        auto Sz2 = cache.mpo<IQMPO>(format("Sz2 N=%d",N),sites,[&sites]() { return makeTotSz2(sites); });
+        auto lattice = triangularLattice(Nx,Ny,{"YPeriodic",true});
+        auto basis = rotateXZ<IQTensor>(sites);
+        auto gate_cache = GateCache<IQTensor>(sites);
+        auto M = ScanModel{std::move(sites),std::move(lattice),std::move(basis),
+                           std::move(S2),std::move(Sxy2),std::move(Sz2),std::move(gate_cache)};
+        return models.emplace(Ny,std::move(M)).first->second;
+        };
+
+    std::map<std::string,std::pair<IQMPO,IQMPO>> Hs;
+
+    std::ofstream summary(prefix+".dat");
+    summary << "# point Ny hz Jz Jxy beta file\n";
+
+    int running = 0,
+        failed = 0;
+    auto waitWorker = [&running,&failed]()
+        {
+        int status = 0;
+        auto pid = wait(&status);
+        if(pid < 0) return;
+        --running;
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+            ++failed;
+            printfln("Worker %d failed",pid);
+            }
+        };
+
+    for(auto const& p : points)
+        {
+        auto& M = model(p.Ny);
+        auto const& sites = M.sites;
+        auto N = Nx*p.Ny;
+
+        Args args;
+        args.add("Nx",Nx);
+        args.add("Ny",p.Ny);
+        args.add("Maxm",maxm);
+        args.add("Cutoff",cutoff);
+        args.add("YPeriodic",true);
+        args.add("Jxy",p.Jxy);
+        args.add("Jz",p.Jz);
+        args.add("hz",p.hz);
+        args.add("hx",0.);
+        args.add("MeasureThreads",measure_threads);
+        args.add("MemoryPool",mempool);
+        args.add("PoolTopPad",pool_top_pad);
+        args.add("PoolMaxMB",pool_max);
+        args.add("SnapshotPrefix",format("%s_%04d",prefix,p.num));
+
+        auto ampo = AutoMPO(sites);
+        for(auto b : M.lattice)
+            {
+            ampo += (0.5*p.Jxy),"S+",b.s1,"S-",b.s2;
+            ampo += (0.5*p.Jxy),"S-",b.s1,"S+",b.s2;
+            ampo += p.Jz,"Sz",b.s1,"Sz",b.s2;
+            }
+        if(p.hz != 0.0)
+            {
+            for(int n = 1; n <= N; ++n) ampo += -p.hz,"Sz",n;
+            }
+
+        auto hdesc = format("triangular Nx=%d Ny=%d YPeriodic=1 Jxy=%.17g Jz=%.17g hz=%.17g",
+                            Nx,p.Ny,p.Jxy,p.Jz,p.hz);
+
+        //Points differing only by beta share H and H^2
+        if(!Hs.count(hdesc))
+            {
+            auto H = cache.mpo<IQMPO>("H "+hdesc,sites,[&ampo]() { return IQMPO(ampo); });
+            auto H2 = cache.mpo<IQMPO>("H2 Cutoff=1E-12 Maxm=200 "+hdesc,sites,[&H]()
+                {
+                auto H2 = IQMPO();
+                nmultMPO(H,H,H2,"Cutoff=1E-12,Maxm=200");
+                return H2;
+                });
+            Hs[hdesc] = std::make_pair(H,H2);
+            }
+
+        auto mpos = METTSMPOs();
+        mpos.H = Hs.at(hdesc).first;
+        mpos.H2 = Hs.at(hdesc).second;
+        mpos.S2 = M.S2;
+        mpos.Sxy2 = M.Sxy2;
+        mpos.Sz2 = M.Sz2;
+
+        //Adjust tau so that it divides beta/2
+        auto nt = std::max(1,int(std::ceil(p.beta/(2*tau)-1E-9)));
+        auto tau_b = p.beta/(2.*nt);
+
+        auto gates = GateList<IQTensor>();
+        auto expH = ExpH<IQTensor>();
+        if(evolver == "mpo")
+            {
+            expH = makeExpH<IQTensor>(ampo,tau_b,cache,hdesc,{"RealStep",realstep});
+            }
+        else
+            {
+            auto gdesc = format("gates tau=%.17g hx=0 %s",tau_b,hdesc);
+            gates = cache.gates<IQTensor>(gdesc,sites,[&]()
+                {
+                return makeGates<IQTensor>(sites,M.lattice,tau_b,HeisOps(sites,Nx,p.Ny,args),M.gate_cache);
+                });
+            }
+        printfln("Point %d: Ny=%d hz=%.10f Jz=%.10f Jxy=%.10f beta=%.10f, gate cache holds %d distinct gates",
+                 p.num,p.Ny,p.hz,p.Jz,p.Jxy,p.beta,M.gate_cache.size());
+
+        auto result = format("%s_%04d.dat",prefix,p.num);
+        summary << format("%d %d %.14f %.14f %.14f %.14f %s\n",p.num,p.Ny,p.hz,p.Jz,p.Jxy,p.beta,result);
+        summary.flush();
+
+        while(running >= nworkers) waitWorker();
+
+        std::cout.flush();
+        auto pid = fork();
+        if(pid < 0) Error("fork failed");
+        if(pid > 0)
+            {
+            ++running;
+            continue;
+            }
+
+        //
+        // Child process: run the chain of this point
+        //
+        if(!freopen(format("%s_%04d.log",prefix,p.num).c_str(),"w",stdout))
+            {
+            Error("Could not open log file of point");
+            }
+
+        //The forked children would otherwise all draw the same
+        //random numbers: the parent has not used the generator,
+        //so this first call seeds it differently for each point
+        Global::random(seed+p.num);
+
+        auto state = InitState(sites,"Up");
+        for(int i = 1; i <= Nx; ++i)
+        for(int j = 1; j <= p.Ny; ++j)
+            {
+            state.set((i-1)*p.Ny+j,((i+j)%2==0 ? "Up" : "Dn"));
+            }
+        auto psi = IQMPS(state);
+
+        Args targs;
+        targs.add("Verbose",false);
+        targs.add("Maxm",maxm);
+        targs.add("Minm",6);
+        targs.add("Cutoff",cutoff);
+
+        auto obs = TStateObserver<IQTensor>(psi);
+        auto beta = p.beta;
+        auto evolve = [&](IQMPS& psi)
+            {
+            if(evolver == "mpo")       mpoTEvol(expH,beta/2.,tau_b,psi,obs,targs);
+            else if(evolver == "fast") fastGateTEvol(gates,beta/2.,tau_b,psi,obs,targs);
+            else                       gateTEvol(gates,beta/2.,tau_b,psi,obs,targs);
+            };
+
+        printfln("Point %d: Ny=%d hz=%.10f Jz=%.10f Jxy=%.10f beta=%.10f (tau = %.10f), seed %d",
+                 p.num,p.Ny,p.hz,p.Jz,p.Jxy,p.beta,tau_b,seed+p.num);
+
+        auto stats = METTSStats();
+        runMETTS(psi,evolve,mpos,M.basis,beta,nwarm,nmetts,stats,args);
+
+        {
+        std::ofstream resfile(result);
+        resfile << format("# Ny=%d hz=%.14f Jz=%.14f Jxy=%.14f\n",p.Ny,p.hz,p.Jz,p.Jxy);
+        resfile << "# beta E/N err C/N err chi/N err chi_xy/N err nmetts\n";
+        writeStats(resfile,beta,N,nmetts,stats);
+        }
+        std::cout.flush();
+        fflush(stdout);
+        _exit(0);
+        }
+
+    while(running > 0) waitWorker();
+
+    printfln("Done: %d of %d points completed",int(points.size())-failed,points.size());
+    return failed == 0 ? 0 : 1;
+    }
@@ -0,0 +1,247 @@
+#ifndef __BLOCKSVD_H
+#define __BLOCKSVD_H
+
+#include <algorithm>
+#include <mutex>
+#include "itensor/all.h"
+#include "threadpool.h"
+
+namespace itensor {
+
+//
+// Truncated SVD which can run on several threads at once.
+//
+// blockSVD(AA,U,S,V,args) has the same meaning as svd(AA,U,S,V,args):
+// the indices of U on entry are the row indices of AA, and on return
+// AA ~ U*S*V. It returns the truncation error, the discarded weight
+// relative to norm(AA)^2.
+//
+// ITensor's index id generator is not thread safe, so new indices
+// are only made under indexMutex() (see threadpool.h). For real
+// IQTensors only the combiners and the new bond indices are made
+// under the lock: the combined matrix is block diagonal in the QN
+// sectors, and each block is copied into a Matrix and decomposed by
+// the same SVD routine svd uses, outside of the lock. Otherwise svd
+// is called under the lock.
+//
+// The states kept are the largest singular values of all blocks,
+// at most "Maxm" and at least "Minm" of them, dropping the smallest
+// as long as their total weight is at most "Cutoff" times norm(AA)^2.
+//
+template<class Tensor>
+Real
+blockSVD(Tensor const& AA,
+         Tensor& U,
+         Tensor& S,
+         Tensor& V,
+         Args const& args = Global::args());
+
+
+//
+// Implementations
+//
+
+//
+// Start of block (i,j) in the storage d of a rank 2 tensor,
+// nullptr if the block is absent
+//
+template<class Storage>
+Real*
+blockData(Storage& d,
+          long i,
+          long j)
+    {
+    for(auto const& bo : d.offsets)
+        {
+        if(bo.block[0] == i && bo.block[1] == j) return d.store.data()+bo.offset;
+        }
+    return nullptr;
+    }
+
+//
+// SVD of the QN blocks of a real IQTensor, returning
+// false if AA does not have the required form
+//
+inline bool
+svdBlocks(IQTensor const& AA,
+          IQTensor& U,
+          IQTensor& S,
+          IQTensor& V,
+          Real& truncerr,
+          Args const& args)
+    {
+    if(isComplex(AA)) return false;
+
+    auto maxm = args.getInt("Maxm",MAX_M);
+    auto minm = args.getInt("Minm",1);
+    auto cutoff = args.getReal("Cutoff",MIN_CUT);
+
+    auto rows = std::vector<IQIndex>();
+    auto cols = std::vector<IQIndex>();
+    for(auto& i : AA.inds())
+        {
+        if(hasindex(U,i)) rows.push_back(i);
+        else              cols.push_back(i);
+        }
+    if(rows.empty() || cols.empty()) return false;
+
+    IQTensor Cl,Cr;
+        {
+        std::lock_guard<std::mutex> lock(indexMutex());
+        Cl = combiner(rows);
+        Cr = combiner(cols);
+        }
+    auto M = AA*Cl*Cr;
+    M.scaleTo(1.);
+    auto* w = dynamic_cast<ITWrap<QDense<Real>>*>(M.store().get());
+    if(!w) return false;
+    auto& d = w->d;
+
+    //i0 labels the rows of the blocks of M, i1 their columns.
+    //Both are combined indices, so each QN sector of i0 is in
+    //at most one block.
+    auto i0 = M.inds()[0];
+    auto i1 = M.inds()[1];
+
+    struct Block
+        {
+        long r = 0,
+             c = 0;
+        Matrix P,
+               Q;
+        Vector s;
+        long kept = 0,
+             sector = -1;
+        };
+    auto blocks = std::vector<Block>();
+    auto weights = std::vector<std::pair<Real,long>>();
+    Real total = 0;
+    for(auto const& bo : d.offsets)
+        {
+        auto b = Block();
+        b.r = bo.block[0];
+        b.c = bo.block[1];
+        auto nr = i0.index(b.r+1).m();
+        auto nc = i1.index(b.c+1).m();
+        auto Mb = Matrix(nr,nc);
+        std::copy(d.store.data()+bo.offset,d.store.data()+bo.offset+nr*nc,Mb.data());
+        SVD(Mb,b.P,b.s,b.Q);
+        for(long k = 0; k < long(b.s.size()); ++k)
+            {
+            auto x = b.s.data()[k];
+            weights.emplace_back(x*x,blocks.size());
+            total += x*x;
+            }
+        blocks.push_back(std::move(b));
+        }
+    if(weights.empty() || total == 0) return false;
+
+    //Keep the largest weights, as svd does
+    std::sort(weights.begin(),weights.end(),
+              [](std::pair<Real,long> const& a, std::pair<Real,long> const& b) { return a.first > b.first; });
+    long n = weights.size();
+    Real discarded = 0;
+    while(n > std::max(1,maxm))
+        {
+        discarded += weights.at(n-1).first;
+        --n;
+        }
+    while(n > std::max(1,minm) && discarded+weights.at(n-1).first <= cutoff*total)
+        {
+        discarded += weights.at(n-1).first;
+        --n;
+        }
+    for(long k = 0; k < n; ++k) ++blocks.at(weights.at(k).second).kept;
+    truncerr = discarded/total;
+
+    //New bond indices, sector n of both carrying the QN
+    //of the rows of the n-th block kept
+    IQIndex l0,l1;
+        {
+        std::lock_guard<std::mutex> lock(indexMutex());
+        auto s0 = IQIndex::storage();
+        auto s1 = IQIndex::storage();
+        for(auto& b : blocks)
+            {
+            if(b.kept == 0) continue;
+            b.sector = s0.size();
+            s0.emplace_back(Index("ul",b.kept),i0.qn(b.r+1));
+            s1.emplace_back(Index("vl",b.kept),i0.qn(b.r+1));
+            }
+        l0 = IQIndex("ul",std::move(s0),i0.dir());
+        l1 = IQIndex("vl",std::move(s1),i0.dir());
+        }
+
+    //M = T0*D*T1 with T0 = (i0,l0), D = (l0,l1) diagonal
+    //and T1 = (l1,i1), which carries the QN flux of M
+    auto is0 = IQIndexSet(i0,dag(l0));
+    auto isD = IQIndexSet(l0,dag(l1));
+    auto is1 = IQIndexSet(l1,i1);
+    auto d0 = QDense<Real>(is0,QN());
+    auto dD = QDiag<Real>(isD);
+    auto d1 = QDense<Real>(is1,div(M));
+    for(auto& b : blocks)
+        {
+        if(b.kept == 0) continue;
+        auto nr = long(nrows(b.P));
+        auto nc = long(nrows(b.Q));
+        auto p0 = blockData(d0,b.r,b.sector);
+        auto pD = blockData(dD,b.sector,b.sector);
+        auto p1 = blockData(d1,b.sector,b.c);
+        if(!p0 || !pD || !p1) Error("blockSVD: missing block");
+        std::copy(b.P.data(),b.P.data()+nr*b.kept,p0);
+        std::copy(b.s.data(),b.s.data()+b.kept,pD);
+        //The rows of T1 are the columns of Q
+        for(long c = 0; c < nc; ++c)
+        for(long k = 0; k < b.kept; ++k)
+            {
+            p1[k+c*b.kept] = b.Q.data()[c+k*nc];
+            }
+        }
+
+    auto T0 = IQTensor(std::move(is0),std::move(d0));
+    auto T1 = IQTensor(std::move(is1),std::move(d1));
+    S = IQTensor(std::move(isD),std::move(dD));
+    if(i0 == commonIndex(M,Cl))
+        {
+        U = T0*dag(Cl);
+        V = T1*dag(Cr);
+        }
+    else
+        {
+        U = T1*dag(Cl);
+        V = T0*dag(Cr);
+        }
+    return true;
+    }
+
+inline bool
+svdBlocks(ITensor const& AA,
+          ITensor& U,
+          ITensor& S,
+          ITensor& V,
+          Real& truncerr,
+          Args const& args)
+    {
+    return false;
+    }
+
+template<class Tensor>
+Real
+blockSVD(Tensor const& AA,
+         Tensor& U,
+         Tensor& S,
+         Tensor& V,
+         Args const& args)
+    {
+    Real truncerr = 0;
+    if(svdBlocks(AA,U,S,V,truncerr,args)) return truncerr;
+
+    std::lock_guard<std::mutex> lock(indexMutex());
+    auto spec = svd(AA,U,S,V,args);
+    return spec.truncerr();
+    }
+
+} //namespace itensor
+
+#endif //__BLOCKSVD_H
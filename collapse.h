@@ -9,88 +9,144 @@
 
 namespace itensor {
 
+//
+// Sample the state of site j of psi, given the outcomes at
+// sites 1..j-1, and replace site j by the sampled state.
+// Aj holds site j of psi projected on those outcomes: on entry
+// for j = 1 it is toITensor(psi.A(1)), with psi in canonical
+// form centered at site 1, and on return it is updated for j+1.
+// The sites must be collapsed in order, j = 1..N.
+//
 template <typename Tensor>
-std::vector<int>
-collapse(MPSt<Tensor>& psi,
-         const BasisPtr<Tensor>& B,
-         const Args& args = Global::args())
+int
+collapseSite(MPSt<Tensor>& psi,
+             const BasisPtr<Tensor>& B,
+             int j,
+             ITensor& Aj,
+             const Args& args = Global::args())
     {
     const auto N = psi.N();
-    const auto d = psi.sites()(1).m();
-    //const auto d = psi.model()(1).m();
+    const auto d = psi.sites()(j).m();
 
-    std::vector<int> state(N+1);
-        
     //note: in case of IQTensors, we need to convert the MPS iteratively into ITensor
     //otherwise symmetry breaking measurements (e.g. X-projections) cannot be applied!
-    ITensor Aj1, Aj2;
-       // Print(div(psi.A(1)));
+    ITensor Aj2;
+    if(j < N) Aj2 = toITensor(psi.A(j+1));
 
+    //auto prob = Vector(d);
+    std::vector<double> prob(d);
+    Real tot = 0;
         
-    psi.position(1);
-    for(int j = 1; j <= N; ++j)
+    //measure probabilities
+    for(int s = 1; s < d; ++s)
         {
-        //project into Itensor
-        if(j==1) Aj1 = toITensor(psi.A(j));
-        else     Aj1 = Aj2;
-            
+        //calculate overlap with projector
+        auto z = (dag(prime(Aj,Site))*toITensor(B->proj(j,s,args))*Aj).cplx();
+        prob[s-1] = (z.real());
             
-        Aj2 = toITensor(psi.A(j+1));
+        if(z.real() > 1.00000001 || z.real() < 0.  )
+        {
+            Print(z);
+            Print(prob[s-1]);
+            Error("projetor probability > 1 or < 0");
+        }
 
-        //auto prob = Vector(d);
-        std::vector<double> prob(d);
-        Real tot = 0;
-            
-        //measure probabilities
-        for(int s = 1; s < d; ++s)
-            {
-            //calculate overlap with projector
-            auto z = (dag(prime(Aj1,Site))*toITensor(B->proj(j,s,args))*Aj1).cplx();
-            prob[s-1] = (z.real());
-                
-            if(z.real() > 1.00000001 || z.real() < 0.  )
-            {
-                Print(z);
-                Print(prob[s-1]);
-                Error("projetor probability > 1 or < 0");
-            }
-
-            tot += prob[s-1];
-
-            }
-        prob[d-1] = 1-tot;
-
-        //get a random number in [0,1]
-        const auto r = Global::random();
-            
+        tot += prob[s-1];
+
+        }
+    prob[d-1] = 1-tot;
+
+    //get a random number in [0,1]
+    const auto r = Global::random();
+        
 #ifdef DEBUG
-        if(r < 0 || r > 1) Error("Bad result from RNG: r outside interval [0,1]");
+    if(r < 0 || r > 1) Error("Bad result from RNG: r outside interval [0,1]");
 #endif
 
-        //pick local product state
-        auto& st = state.at(j);
-        st = 1;
-        Real pdisc = prob[st-1];
+    //pick local product state
+    int st = 1;
+    Real pdisc = prob[st-1];
 
-        while(r > pdisc)
-            {
-            ++st;
-            pdisc += prob[st-1];
-            }
-            
-        //project into product state
-        psi.Anc(j) = B->newstate(j,st,args);
-        if(j < N)
-            {
-            Aj2 *= dag(toITensor(B->state(j,st,args)))*Aj1;
-            Aj2 *=1./std::sqrt(prob[st-1]);
-            }
-            
+    while(r > pdisc)
+        {
+        ++st;
+        pdisc += prob[st-1];
+        }
+        
+    //project into product state
+    psi.Anc(j) = B->newstate(j,st,args);
+    if(j < N)
+        {
+        Aj2 *= dag(toITensor(B->state(j,st,args)))*Aj;
+        Aj2 *=1./std::sqrt(prob[st-1]);
+        Aj = Aj2;
+        }
+
+    return st;
+    }
+
+template <typename Tensor>
+std::vector<int>
+collapse(MPSt<Tensor>& psi,
+         const BasisPtr<Tensor>& B,
+         const Args& args = Global::args())
+    {
+    const auto N = psi.N();
+
+    std::vector<int> state(N+1);
+        
+    psi.position(1);
+    auto Aj = toITensor(psi.A(1));
+    for(int j = 1; j <= N; ++j)
+        {
+        state.at(j) = collapseSite(psi,B,j,Aj,args);
         }
 
     return state;
     }
 
+//
+// Sample a product state of the physical sites from a
+// purified thermal state psi on 2N sites, where the physical
+// sites are the odd sites and the ancillas are the even sites.
+// All sites are collapsed in the basis B in order; the ancilla
+// outcomes are discarded, which traces out the ancillas. The
+// returned state can be used with setProductState to start a
+// METTS chain near equilibrium.
+//
+template <typename Tensor>
+std::vector<int>
+samplePurified(MPSt<Tensor> psi,
+               const BasisPtr<Tensor>& B,
+               const Args& args = Global::args())
+    {
+    const auto N = psi.N()/2;
+    auto all = collapse(psi,B,args);
+    std::vector<int> state(N+1);
+    for(int j = 1; j <= N; ++j)
+        {
+        state.at(j) = all.at(2*j-1);
+        }
+    return state;
+    }
+
+//
+// Replace psi by the product state with site j
+// in the state state[j] of the basis B
+//
+template <typename Tensor>
+void
+setProductState(MPSt<Tensor>& psi,
+                const BasisPtr<Tensor>& B,
+                const std::vector<int>& state,
+                const Args& args = Global::args())
+    {
+    for(int j = 1; j <= psi.N(); ++j)
+        {
+        psi.Anc(j) = B->newstate(j,state.at(j),args);
+        }
+    }
+
 };
 
 
@@ -0,0 +1,174 @@
+#ifndef __CORRELATIONS_H
+#define __CORRELATIONS_H
+
+#include "itensor/mps/mps.h"
+
+namespace itensor {
+
+//
+// Compute <psi| op1_i0 op2_j |phi> for every site j in js.
+//
+// All values are obtained from one set of left and right
+// environments, for a total cost of order N m^3. Neither psi
+// nor phi is modified, so no new indices are created and this
+// can be called on several states concurrently.
+//
+template<class Tensor>
+std::vector<Cplx>
+correlations(MPSt<Tensor> const& psi,
+             MPSt<Tensor> const& phi,
+             std::string const& op1,
+             int i0,
+             std::string const& op2,
+             std::vector<int> const& js);
+
+//
+// Compute <psi| op_j |phi> for every site j in js,
+// from one set of left and right environments
+//
+template<class Tensor>
+std::vector<Cplx>
+matrixElements(MPSt<Tensor> const& psi,
+               MPSt<Tensor> const& phi,
+               std::string const& op,
+               std::vector<int> const& js);
+
+//
+// Normalized correlation function <psi|op1_i0 op2_j|psi>/<psi|psi>
+//
+template<class Tensor>
+std::vector<Real>
+correlations(MPSt<Tensor> const& psi,
+             std::string const& op1,
+             int i0,
+             std::string const& op2,
+             std::vector<int> const& js);
+
+
+//
+// Implementations
+//
+
+template<class Tensor>
+Tensor
+multEnv(Tensor const& A, Tensor const& B)
+    {
+    if(!A) return B;
+    if(!B) return A;
+    return A*B;
+    }
+
+template<class Tensor>
+std::vector<Cplx>
+correlations(MPSt<Tensor> const& psi,
+             MPSt<Tensor> const& phi,
+             std::string const& op1,
+             int i0,
+             std::string const& op2,
+             std::vector<int> const& js)
+    {
+    auto const& sites = phi.sites();
+    auto N = phi.N();
+
+    //Transfer matrix of site n, with the operator op acting on phi
+    auto transfer = [&](int n, std::string const& op)
+        {
+        auto K = phi.A(n);
+        if(op != "") K = noprime(K*sites.op(op,n),Site);
+        return K*dag(prime(psi.A(n),Link));
+        };
+
+    //L.at(n) contracts sites 1..n, R.at(n) sites n..N
+    auto L = std::vector<Tensor>(N+2);
+    auto R = std::vector<Tensor>(N+2);
+    for(int n = 1; n <= N; ++n)
+        {
+        L.at(n) = multEnv(L.at(n-1),transfer(n,""));
+        }
+    for(int n = N; n >= 1; --n)
+        {
+        R.at(n) = multEnv(transfer(n,""),R.at(n+1));
+        }
+
+    //Operator op1 at i0 followed by op2 at j > i0
+    auto right = std::vector<Cplx>(N+1);
+    auto E = multEnv(L.at(i0-1),transfer(i0,op1));
+    for(int j = i0+1; j <= N; ++j)
+        {
+        right.at(j) = multEnv(multEnv(E,transfer(j,op2)),R.at(j+1)).cplx();
+        E = E*transfer(j,"");
+        }
+
+    //Operator op1 at i0 preceded by op2 at j < i0
+    auto left = std::vector<Cplx>(N+1);
+    E = multEnv(transfer(i0,op1),R.at(i0+1));
+    for(int j = i0-1; j >= 1; --j)
+        {
+        left.at(j) = multEnv(L.at(j-1),multEnv(transfer(j,op2),E)).cplx();
+        E = transfer(j,"")*E;
+        }
+
+    auto res = std::vector<Cplx>();
+    for(auto j : js)
+        {
+        if(j > i0)      res.push_back(right.at(j));
+        else if(j < i0) res.push_back(left.at(j));
+        else            res.push_back(multEnv(multEnv(L.at(i0-1),transfer(i0,op1+"*"+op2)),R.at(i0+1)).cplx());
+        }
+    return res;
+    }
+
+template<class Tensor>
+std::vector<Cplx>
+matrixElements(MPSt<Tensor> const& psi,
+               MPSt<Tensor> const& phi,
+               std::string const& op,
+               std::vector<int> const& js)
+    {
+    auto const& sites = phi.sites();
+    auto N = phi.N();
+
+    auto transfer = [&](int n, bool withop)
+        {
+        auto K = phi.A(n);
+        if(withop) K = noprime(K*sites.op(op,n),Site);
+        return K*dag(prime(psi.A(n),Link));
+        };
+
+    auto L = std::vector<Tensor>(N+2);
+    auto R = std::vector<Tensor>(N+2);
+    for(int n = 1; n <= N; ++n)
+        {
+        L.at(n) = multEnv(L.at(n-1),transfer(n,false));
+        }
+    for(int n = N; n >= 1; --n)
+        {
+        R.at(n) = multEnv(transfer(n,false),R.at(n+1));
+        }
+
+    auto res = std::vector<Cplx>();
+    for(auto j : js)
+        {
+        res.push_back(multEnv(multEnv(L.at(j-1),transfer(j,true)),R.at(j+1)).cplx());
+        }
+    return res;
+    }
+
+template<class Tensor>
+std::vector<Real>
+correlations(MPSt<Tensor> const& psi,
+             std::string const& op1,
+             int i0,
+             std::string const& op2,
+             std::vector<int> const& js)
+    {
+    auto C = correlations(psi,psi,op1,i0,op2,js);
+    auto nrm2 = overlap(psi,psi);
+    auto res = std::vector<Real>();
+    for(auto c : C) res.push_back(c.real()/nrm2);
+    return res;
+    }
+
+} //namespace itensor
+
+#endif //__CORRELATIONS_H
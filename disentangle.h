@@ -0,0 +1,145 @@
+#ifndef __DISENTANGLE_H
+#define __DISENTANGLE_H
+
+#include "itensor/mps/mps.h"
+#include "itensor/mps/bondgate.h"
+
+namespace itensor {
+
+//
+// Disentangle the ancilla sites (even sites) of a purified
+// thermal state. Because the ancillas never interact, any
+// unitary acting only on them leaves expectation values of
+// physical operators unchanged, but it can remove entanglement
+// which the imaginary time evolution builds up between ancillas.
+//
+// For each pair of neighboring ancillas j,j+2 the physical site
+// j+1 between them is swapped out of the way, a two-ancilla unitary
+// minimizing the second Renyi entropy of the bond between them is
+// found iteratively (Hauschild et al., PRB 98, 235163 (2018)),
+// then the physical site is swapped back.
+//
+// Returns the total decrease of the bond Renyi entropies.
+//
+template<class Tensor>
+Real
+disentangleAncilla(MPSt<Tensor>& psi,
+                   Args const& args = Global::args());
+
+//
+// Find the unitary acting on the site indices of sites n1,n2 of
+// the two-site wavefunction theta which maximizes the purity of
+// the reduced density matrix of the left half (the link l and the
+// site n1). On return dS holds the decrease of the Renyi entropy.
+//
+template<class Tensor>
+Tensor
+optimalDisentangler(Tensor const& theta,
+                    SiteSet const& sites,
+                    int n1, int n2,
+                    typename Tensor::index_type const& l,
+                    Real& dS,
+                    Args const& args = Global::args());
+
+
+//
+// Implementations
+//
+
+template<class Tensor>
+Tensor
+optimalDisentangler(Tensor const& theta,
+                    SiteSet const& sites,
+                    int n1, int n2,
+                    typename Tensor::index_type const& l,
+                    Real& dS,
+                    Args const& args)
+    {
+    auto maxiter = args.getInt("DisentangleIter",10);
+    auto tol = args.getReal("DisentangleTol",1E-10);
+
+    auto s1 = sites.si(n1),
+         s2 = sites.si(n2);
+
+    //Purity of the left half of U*theta; rt is set to rho applied
+    //to the left half of U*theta, rho having indices (l,s1,l',s1')
+    auto measure = [&theta,&l,&s1](Tensor const& U, Tensor& rt)
+        {
+        auto thp = noprime(U*theta);
+        auto rho = thp*dag(prime(thp,l,s1));
+        rt = rho*prime(thp,l,s1);
+        return (dag(thp)*rt).real();
+        };
+
+    auto U = sites.op("Id",n1)*sites.op("Id",n2);
+    Tensor rt;
+    auto start_purity = measure(U,rt);
+    auto purity = start_purity;
+    for(int it = 1; it <= maxiter; ++it)
+        {
+        //
+        // Derivative of tr(rho^2) with respect to U,
+        // the best unitary is its polar factor
+        //
+        auto E = prime(rt,s1,s2)*dag(theta);
+        Tensor W(prime(s1),prime(s2)),D,V;
+        svd(E,W,D,V,{"Cutoff",1E-14});
+
+        //E rank deficient: polar factor not unitary, keep U
+        if(commonIndex(W,D).m() < s1.m()*s2.m()) break;
+
+        D.apply([](Real x) { return 1.; });
+        U = W*D*V;
+
+        //purity always belongs to the current U
+        auto pur = measure(U,rt);
+        auto converged = (std::fabs(pur-purity) < tol);
+        purity = pur;
+        if(converged) break;
+        }
+
+    dS = std::log(purity/start_purity);
+
+    return U;
+    }
+
+template<class Tensor>
+Real
+disentangleAncilla(MPSt<Tensor>& psi,
+                   Args const& args)
+    {
+    auto const& sites = psi.sites();
+    auto N = psi.N();
+
+    Real dStot = 0;
+    for(int j = 2; j+2 <= N; j += 2)
+        {
+        //Swap physical site j+1 into position j,
+        //ancillas j and j+2 then sit at j+1 and j+2
+        psi.position(j);
+        auto sw = BondGate<Tensor>(sites,j,j+1);
+        auto AA = psi.A(j)*psi.A(j+1)*sw.gate();
+        AA.mapprime(1,0,Site);
+        psi.svdBond(j,AA,Fromleft,args);
+
+        auto theta = psi.A(j+1)*psi.A(j+2);
+        auto l = commonIndex(psi.A(j),psi.A(j+1),Link);
+
+        Real dS = 0;
+        auto U = optimalDisentangler(theta,sites,j+1,j+2,l,dS,args);
+        dStot += dS;
+        theta = noprime(U*theta);
+        psi.svdBond(j+1,theta,Fromright,args);
+
+        //Swap the physical site back
+        AA = psi.A(j)*psi.A(j+1)*sw.gate();
+        AA.mapprime(1,0,Site);
+        psi.svdBond(j,AA,Fromleft,args);
+        }
+
+    return dStot;
+    }
+
+} //namespace itensor
+
+#endif //__DISENTANGLE_H
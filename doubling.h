@@ -0,0 +1,199 @@
+#ifndef __DOUBLING_H
+#define __DOUBLING_H
+
+#include "itensor/all.h"
+#include "mpo_tevol.h"
+
+namespace itensor {
+
+//
+// Beta doubling (exponential tensor renormalization group) for
+// the density operator of the physical sites as an MPO.
+//
+// rho(t) = exp(-t H) is first made by linear steps with the factors
+// of exp(-tau H), starting from the identity, up to rho(beta0/2).
+// It is then squared repeatedly, rho(2t) = rho(t)^2, until the
+// inverse temperature beta is reached, which must therefore be
+// beta0 times a power of two. Each product is
+// compressed with the "Maxm" and "Cutoff" args. A temperature
+// 1/beta is thus reached in about log2(beta/beta0) products instead
+// of beta/(2 tau) time steps.
+//
+// At inverse temperature 2t, observables are measured as
+//   <O> = Tr(rho^dag O rho)/Tr(rho^dag rho),
+// the same as <psi|O|psi> for the purified state of mpo_ancilla.
+//
+// The scale factors removed by normalizing rho are accumulated, which
+// gives log Z(2t) = log Tr(exp(-2t H)) at each measurement: starting
+// from the identity, Tr(1) = 2^N is included in the first of them.
+//
+
+struct DoublingPoint
+    {
+    Real beta = 0,
+         en = 0,  //energy per site
+         sus = 0, //susceptibility per site
+         lnZ = 0; //log of the partition function
+    long maxm = 0;
+    Real cpu = 0; //CPU time used so far
+    };
+
+//
+// Tr(A^dag B)
+//
+template<class Tensor>
+Cplx
+traceMPO(MPOt<Tensor> const& A,
+         MPOt<Tensor> const& B);
+
+//
+// Tr(A^dag H B)
+//
+template<class Tensor>
+Cplx
+traceMPO(MPOt<Tensor> const& A,
+         MPOt<Tensor> const& H,
+         MPOt<Tensor> const& B);
+
+template<class Tensor>
+std::vector<DoublingPoint>
+betaDoubling(ExpH<Tensor> const& expH,
+             Real tau,
+             MPOt<Tensor> const& H,
+             MPOt<Tensor> const& S2,
+             Real beta0,
+             Real beta,
+             Args const& args = Global::args());
+
+
+//
+// Implementations
+//
+
+template<class Tensor>
+Cplx
+traceMPO(MPOt<Tensor> const& A,
+         MPOt<Tensor> const& B)
+    {
+    Tensor E;
+    for(int n = 1; n <= B.N(); ++n)
+        {
+        auto Ad = dag(prime(A.A(n),Link));
+        E = (n == 1 ? B.A(n)*Ad : E*B.A(n)*Ad);
+        }
+    return E.cplx();
+    }
+
+template<class Tensor>
+Cplx
+traceMPO(MPOt<Tensor> const& A,
+         MPOt<Tensor> const& H,
+         MPOt<Tensor> const& B)
+    {
+    Tensor E;
+    for(int n = 1; n <= B.N(); ++n)
+        {
+        //H acts on the primed site index of B,
+        //its output index is matched with A
+        auto Ad = dag(A.A(n));
+        Ad.mapprime(1,2,Site);
+        Ad.prime(Link);
+        auto T = B.A(n)*prime(H.A(n),Site);
+        E = (n == 1 ? T*Ad : E*T*Ad);
+        }
+    return E.cplx();
+    }
+
+template<class Tensor>
+std::vector<DoublingPoint>
+betaDoubling(ExpH<Tensor> const& expH,
+             Real tau,
+             MPOt<Tensor> const& H,
+             MPOt<Tensor> const& S2,
+             Real beta0,
+             Real beta,
+             Args const& args)
+    {
+    using MPOT = MPOt<Tensor>;
+
+    auto const& sites = H.sites();
+    auto N = sites.N();
+
+    auto nt0 = int(beta0/(2*tau)+1E-9);
+    if(nt0 < 1 || fabs(nt0*tau-beta0/2.) > 1E-9)
+        {
+        Error("Starting beta of doubling must be a multiple of 2*tau");
+        }
+
+    //beta must be reached exactly by doublings of beta0
+    auto ndouble = int(std::round(std::log2(beta/beta0)));
+    if(ndouble < 0 || fabs(beta0*std::pow(2.,ndouble)-beta) > 1E-9*beta)
+        {
+        Error(format("beta = %.10f is not beta0 = %.10f times a power of two",beta,beta0));
+        }
+
+    auto cpu_start = cpu_mytime();
+
+    //Keep rho normalized, Tr(rho^dag rho) = 1. The true density
+    //operator exp(-t H) is exp(lnc) rho, so log Z(2t) = 2 lnc.
+    Real lnc = 0;
+    auto normalize = [&lnc](MPOT& rho)
+        {
+        auto nrm2 = traceMPO(rho,rho).real();
+        rho.Aref(1) /= std::sqrt(nrm2);
+        lnc += 0.5*std::log(nrm2);
+        };
+
+    auto points = std::vector<DoublingPoint>();
+    auto measure = [&](MPOT const& rho, Real bb)
+        {
+        auto p = DoublingPoint();
+        p.beta = bb;
+        auto nrm2 = traceMPO(rho,rho).real();
+        p.en = traceMPO(rho,H,rho).real()/nrm2/N;
+        p.sus = (traceMPO(rho,S2,rho).real()/nrm2)*bb/3./N;
+        p.lnZ = 2*lnc;
+        for(int b = 1; b < N; ++b)
+            {
+            p.maxm = std::max(p.maxm,commonIndex(rho.A(b),rho.A(b+1),Link).m());
+            }
+        p.cpu = cpu_mytime()-cpu_start;
+        printfln("\nbeta = %.4f  Energy/N = %.14f  chi/N = %.14f  F/N = %.14f  maxm = %d  cpu = %.2f",
+                 p.beta,p.en,p.sus,-p.lnZ/bb/N,p.maxm,p.cpu);
+        points.push_back(p);
+        };
+
+    //Linear start from the identity
+    printfln("Doing %d linear steps of tau=%f up to beta = %.4f",nt0,tau,beta0);
+    auto rho = MPOT(sites);
+    for(int tt = 1; tt <= nt0; ++tt)
+        {
+        for(auto& K : expH)
+            {
+            MPOT Krho;
+            nmultMPO(K,rho,Krho,args);
+            rho = std::move(Krho);
+            }
+        normalize(rho);
+        }
+
+    auto bb = beta0;
+    measure(rho,bb);
+
+    for(int n = 1; n <= ndouble; ++n)
+        {
+        MPOT rho2;
+        nmultMPO(rho,rho,rho2,args);
+        rho = std::move(rho2);
+        lnc *= 2;
+        normalize(rho);
+        bb *= 2;
+        measure(rho,bb);
+        }
+
+    return points;
+    }
+
+} //namespace itensor
+
+#endif //__DOUBLING_H
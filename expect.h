@@ -0,0 +1,147 @@
+#ifndef __EXPECT_H
+#define __EXPECT_H
+
+#include <algorithm>
+#include <thread>
+#include "itensor/mps/mpo.h"
+#include "threadpool.h"
+
+namespace itensor {
+
+//
+// Expectation values <psi|W|psi> of several MPOs W, the same as
+// overlap(psi,W,psi) for each of them, computed on several threads.
+//
+// Each contraction is split at the middle bond c = N/2 into the left
+// environment of sites 1..c and the right environment of sites c+1..N,
+// which are independent and are built concurrently, one from each end
+// of the chain. The two halves are then contracted over bond c. For K
+// MPOs the 2K halves are distributed over "Threads" threads (default
+// 2K; at most 2K and the number of cores), so the latency of a single
+// expectation value is about halved and several MPOs share the cores.
+//
+// The site tensors of psi and of the MPOs are copied on the calling
+// thread before the threads start, since the MPS and MPO accessors
+// are not safe to call concurrently. The copies share the storage of
+// the originals. The threads then only contract the copies and make
+// no new indices.
+//
+template<class Tensor>
+std::vector<Real>
+expectMPOs(MPSt<Tensor> const& psi,
+           std::vector<MPOt<Tensor> const*> const& Ws,
+           Args const& args = Global::args());
+
+template<class Tensor>
+Real
+expectMPO(MPSt<Tensor> const& psi,
+          MPOt<Tensor> const& W,
+          Args const& args = Global::args());
+
+//
+// Same as expectMPOs, for MPOs given by copies of their site
+// tensors, WA[k][j] being site j = 1..N of MPO k. The copies can be
+// made once by mpoSiteTensors on one thread and then used on several
+// threads at once, which the MPOs themselves cannot.
+//
+template<class Tensor>
+std::vector<Real>
+expectMPOTensors(MPSt<Tensor> const& psi,
+                 std::vector<std::vector<Tensor>> const& WA,
+                 Args const& args = Global::args());
+
+template<class Tensor>
+std::vector<std::vector<Tensor>>
+mpoSiteTensors(std::vector<MPOt<Tensor> const*> const& Ws);
+
+
+//
+// Implementations
+//
+
+template<class Tensor>
+std::vector<std::vector<Tensor>>
+mpoSiteTensors(std::vector<MPOt<Tensor> const*> const& Ws)
+    {
+    auto WA = std::vector<std::vector<Tensor>>();
+    for(auto W : Ws)
+        {
+        WA.emplace_back(W->N()+1);
+        for(int j = 1; j <= W->N(); ++j) WA.back().at(j) = W->A(j);
+        }
+    return WA;
+    }
+
+template<class Tensor>
+std::vector<Real>
+expectMPOs(MPSt<Tensor> const& psi,
+           std::vector<MPOt<Tensor> const*> const& Ws,
+           Args const& args)
+    {
+    return expectMPOTensors(psi,mpoSiteTensors(Ws),args);
+    }
+
+template<class Tensor>
+std::vector<Real>
+expectMPOTensors(MPSt<Tensor> const& psi,
+                 std::vector<std::vector<Tensor>> const& WA,
+                 Args const& args)
+    {
+    auto N = psi.N();
+    auto K = int(WA.size());
+    if(K == 0) return {};
+
+    auto c = std::max(1,N/2);
+    auto L = std::vector<Tensor>(K);
+    auto R = std::vector<Tensor>(K);
+
+    auto A = std::vector<Tensor>(N+1);
+    for(int j = 1; j <= N; ++j) A.at(j) = psi.A(j);
+
+    //Task 2k builds the left half of MPO k, task 2k+1 the right half
+    auto half = [&](int task)
+        {
+        auto k = task/2;
+        auto env = [&](int j, Tensor const& E)
+            {
+            auto T = A.at(j)*WA.at(k).at(j)*dag(prime(A.at(j)));
+            return (E ? E*T : T);
+            };
+        if(task%2 == 0)
+            {
+            for(int j = 1; j <= c; ++j) L.at(k) = env(j,L.at(k));
+            }
+        else
+            {
+            for(int j = N; j > c; --j) R.at(k) = env(j,R.at(k));
+            }
+        };
+
+    auto ntasks = (N > 1 ? 2*K : K);
+    auto hw = std::max(1,int(std::thread::hardware_concurrency()));
+    auto nthreads = std::min({ntasks,hw,args.getInt("Threads",ntasks)});
+
+    ThreadPool pool(nthreads > 1 ? nthreads : 0);
+    pool.run(ntasks,[&half,N](int t) { half(N > 1 ? t : 2*t); });
+
+    auto res = std::vector<Real>(K);
+    for(auto k : range(K))
+        {
+        auto E = (N > 1 ? L.at(k)*R.at(k) : L.at(k));
+        res.at(k) = E.cplx().real();
+        }
+    return res;
+    }
+
+template<class Tensor>
+Real
+expectMPO(MPSt<Tensor> const& psi,
+          MPOt<Tensor> const& W,
+          Args const& args)
+    {
+    return expectMPOs(psi,{&W},args).front();
+    }
+
+} //namespace itensor
+
+#endif //__EXPECT_H
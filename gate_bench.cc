@@ -0,0 +1,250 @@
+#include <chrono>
+#include "itensor/all.h"
+#include "heisops.h"
+#include "trotter.h"
+#include "gate_kernel.h"
+#include "TStateObserver.h"
+#include "rsvd.h"
+#include "parallel_tevol.h"
+
+using namespace std;
+using namespace itensor;
+
+//
+// Compares the generic gate application used by gateTEvol
+// with applyGate/fastGateTEvol from gate_kernel.h, and the
+// randomized truncated SVD of rsvd.h with the full SVD, and
+// parallelGateTEvol with gateTEvol
+//
+int
+main(int argc, char* argv[])
+    {
+    if(argc != 2)
+        {
+        printfln("Usage: %s inputfile.",argv[0]);
+        return 0;
+        }
+    auto input = InputGroup(argv[1],"input");
+
+    auto Nx = input.getInt("Nx",6);
+    auto Ny = input.getInt("Ny",3);
+    auto tau = input.getReal("tau",0.1);
+    auto maxm = input.getInt("maxm",200);
+    auto cutoff = input.getReal("cutoff",1E-10);
+    //Time steps used to grow the bond dimension before timing
+    auto nprep = input.getInt("nprep",5);
+    //Time steps timed for each evolver
+    auto nsteps = input.getInt("nsteps",2);
+    //Repetitions of the gate application alone
+    auto reps = input.getInt("reps",10);
+    //Truncation method of fastGateTEvol, see rsvd.h
+    auto svd_method = input.getString("svd_method","full");
+    //Maximum bond dimension of the randomized SVD check, and
+    //largest difference in discarded weight allowed
+    auto rsvd_maxm = input.getInt("rsvd_maxm",20);
+    auto rsvd_tol = input.getReal("rsvd_tol",1E-6);
+    //Segments of parallelGateTEvol, and largest difference of the
+    //energy per site and of the collapse probabilities allowed
+    auto segments = input.getInt("segments",2);
+    auto par_tol = input.getReal("par_tol",1E-3);
+
+    auto N = Nx*Ny;
+    auto sites = SpinHalf(N);
+
+    Args args;
+    args.add("Ny",Ny);
+    args.add("YPeriodic",true);
+    args.add("Maxm",maxm);
+    args.add("Cutoff",cutoff);
+    args.add("Verbose",false);
+
+    auto lattice = triangularLattice(Nx,Ny,args);
+    auto gates = makeGates<IQTensor>(sites,lattice,tau,HeisOps(sites,Nx,Ny,args));
+
+    auto state = InitState(sites);
+    for(int j = 1; j <= N; ++j) state.set(j,(j%2==1 ? "Up" : "Dn"));
+    auto psi0 = IQMPS(state);
+    auto obs = TStateObserver<IQTensor>(psi0);
+
+    println("Growing the bond dimension");
+    gateTEvol(gates,nprep*tau,tau,psi0,obs,args);
+    long maxm_psi = 0;
+    for(int b = 1; b < N; ++b) maxm_psi = std::max(maxm_psi,linkInd(psi0,b).m());
+    printfln("Max bond dimension = %d",maxm_psi);
+
+    //
+    // Gate application alone, on the two-site wavefunctions
+    // of every bond gate and swap in the gate list
+    //
+    auto cpu_generic = 0.;
+    auto cpu_fast = 0.;
+    auto maxdiff = 0.;
+    for(auto& G : gates)
+        {
+        auto psi = psi0;
+        psi.position(G.i1());
+        auto AA = psi.A(G.i1())*psi.A(G.i2());
+
+        auto t0 = cpu_mytime();
+        IQTensor R1;
+        for(int r = 0; r < reps; ++r)
+            {
+            R1 = G.gate()*AA;
+            R1.mapprime(1,0,Site);
+            }
+        auto t1 = cpu_mytime();
+        IQTensor R2;
+        for(int r = 0; r < reps; ++r)
+            {
+            R2 = AA;
+            applyGate(G,R2,sites);
+            }
+        auto t2 = cpu_mytime();
+
+        cpu_generic += t1-t0;
+        cpu_fast += t2-t1;
+        maxdiff = std::max(maxdiff,norm(R1-R2)/norm(R1));
+        }
+    printfln("\nGate application, %d gates x %d reps:",gates.size(),reps);
+    printfln("  generic: %.4f s",cpu_generic);
+    printfln("  fast:    %.4f s",cpu_fast);
+    printfln("  max relative difference = %.3E",maxdiff);
+
+    //
+    // Randomized SVD against the full SVD, truncating the two-site
+    // wavefunction of every bond to rsvd_maxm states
+    //
+    auto rargs = args;
+    rargs.add("Maxm",rsvd_maxm);
+    rargs.add("RSVDOversample",input.getInt("rsvd_oversample",10));
+    rargs.add("RSVDPower",input.getInt("rsvd_power",1));
+    auto cpu_full = 0.;
+    auto cpu_rsvd = 0.;
+    auto maxdw = 0.;
+    auto maxrecon = 0.;
+    auto nrand = 0L;
+    auto psi = psi0;
+    for(int b = 1; b < N; ++b)
+        {
+        psi.position(b);
+        auto AA = psi.A(b)*psi.A(b+1);
+        auto rowsOf = [&]()
+            {
+            return (b == 1 ? IQTensor(sites(b)) : IQTensor(linkInd(psi,b-1),sites(b)));
+            };
+
+        IQTensor Uf = rowsOf(),Sf,Vf;
+        rargs.add("SVDMethod","full");
+        auto t0 = cpu_mytime();
+        auto dwf = svdTruncated(AA,Uf,Sf,Vf,rargs);
+        auto t1 = cpu_mytime();
+
+        IQTensor Ur = rowsOf(),Sr,Vr;
+        rargs.add("SVDMethod","rsvd");
+        auto before = rsvdStats().randomized;
+        auto dwr = svdTruncated(AA,Ur,Sr,Vr,rargs);
+        auto t2 = cpu_mytime();
+        if(rsvdStats().randomized == before) continue;
+
+        ++nrand;
+        cpu_full += t1-t0;
+        cpu_rsvd += t2-t1;
+        maxdw = std::max(maxdw,std::fabs(dwr-dwf));
+        maxrecon = std::max(maxrecon,norm(Uf*Sf*Vf-Ur*Sr*Vr)/norm(AA));
+        }
+    printfln("\nRandomized SVD, maxm = %d, on %d of %d bonds (the others fall back to the full SVD):",
+             rsvd_maxm,nrand,N-1);
+    printfln("  full: %.4f s",cpu_full);
+    printfln("  rsvd: %.4f s",cpu_rsvd);
+    printfln("  max difference in discarded weight = %.3E",maxdw);
+    printfln("  max relative difference of the truncated AA = %.3E",maxrecon);
+    auto rsvd_ok = (nrand > 0 && maxdw <= rsvd_tol);
+    if(!rsvd_ok)
+        {
+        printfln("  FAILED: %s",nrand == 0 ? "randomized branch never taken" : "discarded weight differs by more than rsvd_tol");
+        }
+
+    //
+    // Full time steps, including the truncation SVDs
+    //
+    auto psi1 = psi0;
+    auto t0 = cpu_mytime();
+    gateTEvol(gates,nsteps*tau,tau,psi1,obs,args);
+    auto t1 = cpu_mytime();
+
+    auto psi2 = psi0;
+    auto fargs = args;
+    fargs.add("SVDMethod",svd_method);
+    auto t2 = cpu_mytime();
+    fastGateTEvol(gates,nsteps*tau,tau,psi2,obs,fargs);
+    auto t3 = cpu_mytime();
+
+    printfln("\nTime evolution, %d steps:",nsteps);
+    printfln("  gateTEvol:     %.4f s",t1-t0);
+    printfln("  fastGateTEvol: %.4f s",t3-t2);
+    printfln("  1-|<psi1|psi2>| = %.3E",1.-std::fabs(overlap(psi1,psi2)));
+
+    //
+    // Parallel evolver against gateTEvol. The energy and the
+    // probabilities of the z basis states of each site are computed
+    // as the METTS code does: the energy as <psi|H|psi>, assuming psi
+    // is normalized, and the probabilities from the site tensor at
+    // the orthogonality center only, assuming psi is canonical.
+    //
+    auto groups = makeGateGroups<IQTensor>(sites,lattice,tau,HeisOps(sites,Nx,Ny,args));
+    auto ampo = AutoMPO(sites);
+    for(auto b : lattice)
+        {
+        ampo += 0.5,"S+",b.s1,"S-",b.s2;
+        ampo += 0.5,"S-",b.s1,"S+",b.s2;
+        ampo += 1.0,"Sz",b.s1,"Sz",b.s2;
+        }
+    auto H = IQMPO(ampo);
+    auto probsUp = [&sites,N](IQMPS psi)
+        {
+        auto p = std::vector<Real>(N+1,0.);
+        for(int j = 1; j <= N; ++j)
+            {
+            psi.position(j);
+            auto A = psi.A(j);
+            auto P = 0.5*sites.op("Id",j)+sites.op("Sz",j);
+            p.at(j) = (dag(prime(A,Site))*P*A).real();
+            }
+        return p;
+        };
+    auto wall = []()
+        {
+        using namespace std::chrono;
+        return duration<Real>(steady_clock::now().time_since_epoch()).count();
+        };
+
+    auto psi3 = psi0;
+    auto pargs = args;
+    pargs.add("Segments",1);
+    auto w0 = wall();
+    parallelGateTEvol(groups,nsteps*tau,tau,psi3,obs,pargs);
+    auto w1 = wall();
+
+    psi3 = psi0;
+    pargs.add("Segments",segments);
+    auto w2 = wall();
+    parallelGateTEvol(groups,nsteps*tau,tau,psi3,obs,pargs);
+    auto w3 = wall();
+
+    auto E1 = overlap(psi1,H,psi1)/N;
+    auto E3 = overlap(psi3,H,psi3)/N;
+    auto p1 = probsUp(psi1);
+    auto p3 = probsUp(psi3);
+    auto maxdp = 0.;
+    for(int j = 1; j <= N; ++j) maxdp = std::max(maxdp,std::fabs(p1.at(j)-p3.at(j)));
+
+    printfln("\nparallelGateTEvol on %d segments, %d steps:",segments,nsteps);
+    printfln("  wall time: %.4f s (%.4f s on 1 segment)",w3-w2,w1-w0);
+    printfln("  energy per site %.12f, gateTEvol %.12f",E3,E1);
+    printfln("  1-<psi|psi> = %.3E",1.-overlap(psi3,psi3));
+    printfln("  max difference of the collapse probabilities = %.3E",maxdp);
+    auto par_ok = (std::fabs(E3-E1) <= par_tol && maxdp <= par_tol);
+    if(!par_ok) println("  FAILED: differs from gateTEvol by more than par_tol");
+
+    return (rsvd_ok && par_ok) ? 0 : 1;
+    }
@@ -0,0 +1,288 @@
+#ifndef __GATE_KERNEL_H
+#define __GATE_KERNEL_H
+
+#include <array>
+#include <map>
+#include "itensor/mps/mps.h"
+#include "itensor/mps/bondgate.h"
+#include "itensor/mps/observer.h"
+#include "gatecache.h"
+#include "rsvd.h"
+
+namespace itensor {
+
+//
+// Fast application of two-site gates on spin 1/2 sites.
+//
+// applyGate(G,AA,sites) replaces the two-site wavefunction AA
+// (with unprimed site indices of G.i1(), G.i2()) by G*AA, with
+// unprimed site indices again, i.e. it does the same as
+//   AA = G.gate()*AA; AA.mapprime(1,0,Site);
+// but
+//  - a swap gate only exchanges the two site indices of AA, which
+//    shares the storage of AA and involves no contraction at all
+//  - for real IQTensors on sites with two one-dimensional QN sectors,
+//    the 4x4 gate matrix is applied in place to the QN blocks of AA.
+//    Blocks differing only by the states of the two sites have the
+//    same layout, so the gate acts on groups of at most four blocks
+//    with a fixed size kernel looping over the link dimensions.
+//  - in all other cases the generic contraction is used.
+//
+template<class Tensor>
+void
+applyGate(BondGate<Tensor> const& G,
+          Tensor& AA,
+          SiteSet const& sites);
+
+//
+// Same as gateTEvol, but applying the gates with applyGate
+// and truncating with svdBondTruncated (see rsvd.h). The weight
+// discarded in each step is passed to the observer as "TruncErr".
+//
+template<class Tensor>
+void
+fastGateTEvol(std::list<BondGate<Tensor>> const& gatelist,
+              Real ttotal,
+              Real tstep,
+              MPSt<Tensor>& psi,
+              Observer& obs,
+              Args args = Global::args());
+
+
+//
+// Implementations
+//
+
+//
+// w = g*v for D vectors of length L stored at p[0],...,p[D-1],
+// done in place. The blocks never overlap.
+//
+template<int D>
+void
+gateKernel(Real const* g,
+           std::array<Real*,4> const& p,
+           long L)
+    {
+    std::array<Real,D*D> gg;
+    for(int k = 0; k < D*D; ++k) gg[k] = g[k];
+#pragma GCC ivdep
+    for(long x = 0; x < L; ++x)
+        {
+        Real v[D];
+        for(int d = 0; d < D; ++d) v[d] = p[d][x];
+        for(int c = 0; c < D; ++c)
+            {
+            Real w = 0;
+            for(int d = 0; d < D; ++d) w += gg[c*D+d]*v[d];
+            p[c][x] = w;
+            }
+        }
+    }
+
+inline bool
+isSpinHalfIndex(IQIndex const& s)
+    {
+    return s.nindex() == 2 && s.index(1).m() == 1 && s.index(2).m() == 1;
+    }
+
+//
+// Apply G to the QN blocks of AA, returning false
+// if AA or G do not have the required form
+//
+inline bool
+applyGateBlocks(BondGate<IQTensor> const& G,
+                IQTensor& AA,
+                SiteSet const& sites)
+    {
+    auto const& s1 = sites.si(G.i1());
+    auto const& s2 = sites.si(G.i2());
+    if(!isSpinHalfIndex(s1) || !isSpinHalfIndex(s2)) return false;
+    if(isComplex(AA) || isComplex(G.gate())) return false;
+
+    //Positions of the site indices in AA
+    int p1 = -1, p2 = -1;
+    for(auto j : range(AA.r()))
+        {
+        auto const& I = AA.inds()[j];
+        if(I.primeLevel() != 0) continue;
+        if(I.noprimeEquals(s1)) p1 = j;
+        else if(I.noprimeEquals(s2)) p2 = j;
+        }
+    if(p1 < 0 || p2 < 0) return false;
+
+    if(!AA.store().unique()) AA.store() = AA.store()->clone();
+    auto* w = dynamic_cast<ITWrap<QDense<Real>>*>(AA.store().get());
+    if(!w) return false;
+    auto& d = w->d;
+
+    //Matrix elements g[c][d] with c = 2*(state of s1)+(state of s2), 0-based
+    Real g[4][4];
+    for(int a = 0; a < 2; ++a)
+    for(int b = 0; b < 2; ++b)
+    for(int c = 0; c < 2; ++c)
+    for(int e = 0; e < 2; ++e)
+        {
+        g[2*a+b][2*c+e] = G.gate().real(prime(s1)(a+1),prime(s2)(b+1),s1(c+1),s2(e+1));
+        }
+
+    //Group the blocks which differ only by the states of s1 and s2.
+    //Each group holds the offsets of its blocks (-1 if absent).
+    auto groups = std::map<std::vector<long>,std::array<long,4>>();
+    auto block_end = std::map<long,long>();
+    for(auto const& bo : d.offsets)
+        {
+        auto key = std::vector<long>(bo.block.begin(),bo.block.end());
+        auto c = 2*key.at(p1)+key.at(p2);
+        key.at(p1) = 0;
+        key.at(p2) = 0;
+        auto it = groups.find(key);
+        if(it == groups.end()) it = groups.emplace(key,std::array<long,4>{{-1,-1,-1,-1}}).first;
+        it->second[c] = bo.offset;
+        block_end[bo.offset] = 0;
+        }
+    //Each block ends where the next one starts
+    for(auto it = block_end.begin(); it != block_end.end(); ++it)
+        {
+        auto nt = std::next(it);
+        it->second = (nt == block_end.end() ? long(d.store.size()) : nt->first);
+        }
+
+    for(auto& gr : groups)
+        {
+        //Blocks absent from AA are forbidden by its QN flux, and a QN
+        //conserving gate only mixes blocks allowed by the same flux.
+        //So the gate is applied to the present blocks only.
+        int present[4];
+        int D = 0;
+        auto p = std::array<Real*,4>{{nullptr,nullptr,nullptr,nullptr}};
+        for(int c = 0; c < 4; ++c)
+            {
+            if(gr.second[c] < 0) continue;
+            present[D] = c;
+            p[D] = d.store.data()+gr.second[c];
+            ++D;
+            }
+        auto off = gr.second[present[0]];
+        auto L = block_end.at(off)-off;
+
+        Real gs[16];
+        for(int c = 0; c < D; ++c)
+        for(int e = 0; e < D; ++e)
+            {
+            gs[c*D+e] = g[present[c]][present[e]];
+            }
+
+        switch(D)
+            {
+            case 1: gateKernel<1>(gs,p,L); break;
+            case 2: gateKernel<2>(gs,p,L); break;
+            case 3: gateKernel<3>(gs,p,L); break;
+            case 4: gateKernel<4>(gs,p,L); break;
+            }
+        }
+
+    return true;
+    }
+
+inline bool
+applyGateBlocks(BondGate<ITensor> const& G,
+                ITensor& AA,
+                SiteSet const& sites)
+    {
+    return false;
+    }
+
+template<class Tensor>
+void
+applyGate(BondGate<Tensor> const& G,
+          Tensor& AA,
+          SiteSet const& sites)
+    {
+    if(G.type() == BondGate<Tensor>::Swap)
+        {
+        AA = moveSites(AA,sites,G.i1(),G.i2(),G.i2(),G.i1());
+        return;
+        }
+    if(applyGateBlocks(G,AA,sites)) return;
+
+    AA = G.gate()*AA;
+    AA.mapprime(1,0,Site);
+    }
+
+template<class Tensor>
+void
+fastGateTEvol(std::list<BondGate<Tensor>> const& gatelist,
+              Real ttotal,
+              Real tstep,
+              MPSt<Tensor>& psi,
+              Observer& obs,
+              Args args)
+    {
+    const bool verbose = args.getBool("Verbose",false);
+    const bool normalize = args.getBool("Normalize",true);
+
+    const int nt = int(ttotal/tstep+(1e-9*(ttotal/tstep)));
+    if(fabs(nt*tstep-ttotal) > 1E-9)
+        {
+        Error("Timestep not commensurate with total time");
+        }
+
+    auto const& sites = psi.sites();
+
+    Real tsofar = 0;
+    psi.position(gatelist.front().i1());
+    for(int tt = 1; tt <= nt; ++tt)
+        {
+        Real truncerr = 0;
+        auto g = gatelist.begin();
+        while(g != gatelist.end())
+            {
+            auto i1 = g->i1();
+            auto i2 = g->i2();
+            auto AA = psi.A(i1)*psi.A(i2);
+            applyGate(*g,AA,sites);
+
+            ++g;
+            if(g != gatelist.end())
+                {
+                //Look ahead to the next gate to decide
+                //where to leave the orthogonality center
+                auto ni1 = g->i1();
+                auto ni2 = g->i2();
+                if(ni1 >= i2)
+                    {
+                    truncerr += svdBondTruncated(psi,i1,AA,Fromleft,args);
+                    psi.position(ni1);
+                    }
+                else
+                    {
+                    truncerr += svdBondTruncated(psi,i1,AA,Fromright,args);
+                    psi.position(ni2);
+                    }
+                }
+            else
+                {
+                truncerr += svdBondTruncated(psi,i1,AA,Fromright,args);
+                }
+            }
+
+        if(normalize)
+            {
+            psi.position(gatelist.front().i1());
+            psi.normalize();
+            }
+
+        tsofar += tstep;
+        args.add("TruncErr",truncerr);
+        args.add("TimeStepNum",tt);
+        args.add("Time",tsofar);
+        args.add("TotalTime",ttotal);
+        obs.measure(args);
+        }
+
+    if(verbose) printfln("\nTotal time evolved = %.5f\n",tsofar);
+    }
+
+} //namespace itensor
+
+#endif //__GATE_KERNEL_H
@@ -0,0 +1,140 @@
+#ifndef __GATECACHE_H
+#define __GATECACHE_H
+
+#include <vector>
+#include "itensor/mps/bondgate.h"
+
+namespace itensor {
+
+//
+// Return a copy of T with the site indices of sites f1,f2
+// replaced by those of sites t1,t2 (keeping prime levels and
+// arrow directions). All sites must have the same index
+// structure. The copy shares the storage of T, so no data is
+// copied or moved.
+//
+template<class Tensor>
+Tensor
+moveSites(Tensor const& T,
+          SiteSet const& sites,
+          int f1, int f2,
+          int t1, int t2);
+
+//
+// Cache of two-site imaginary time gates exp(-tau*h).
+//
+// Each distinct bond Hamiltonian h, compared after moving it to
+// sites 1,2, is exponentiated only once per time step tau and
+// bond type. Gates for other bonds share its storage and only
+// differ by their site indices. On a translation invariant lattice
+// the number of stored exponentials is then the number of bond types
+// times the number of distinct field patterns, independent of N.
+//
+// Copies of the returned gates (for example the reversed half of
+// a Trotter step) also share storage since ITensor copies on write.
+//
+template<class Tensor>
+class GateCache
+    {
+    public:
+
+    using GateT = BondGate<Tensor>;
+
+    GateCache(SiteSet const& sites)
+      : sites_(sites)
+        { }
+
+    //
+    // Imaginary time gate exp(-tau*hh) where hh acts on sites i1,i2=i1+1
+    //
+    GateT
+    gate(int i1, int i2,
+         Real tau,
+         Tensor const& hh,
+         std::string const& type = "");
+
+    //Number of distinct exponentials stored
+    int
+    size() const { return entries_.size(); }
+
+    private:
+
+    struct Entry
+        {
+        Real tau;
+        std::string type;
+        Tensor h;
+        Tensor g;
+        };
+
+    SiteSet sites_;
+    std::vector<Entry> entries_;
+    };
+
+
+//
+// Implementations
+//
+
+template<class Tensor>
+Tensor
+moveSites(Tensor const& T,
+          SiteSet const& sites,
+          int f1, int f2,
+          int t1, int t2)
+    {
+    using IndexT = typename Tensor::index_type;
+
+    auto newind = [&sites](IndexT const& i, int t)
+        {
+        auto r = prime(sites.si(t),i.primeLevel());
+        if(r.dir() != i.dir()) r = dag(r);
+        return r;
+        };
+
+    auto inds = std::vector<IndexT>();
+    for(auto& i : T.inds())
+        {
+        if(i.noprimeEquals(sites.si(f1)))      inds.push_back(newind(i,t1));
+        else if(i.noprimeEquals(sites.si(f2))) inds.push_back(newind(i,t2));
+        else                                   inds.push_back(i);
+        }
+
+    auto TT = T;
+    return Tensor(IndexSetT<IndexT>(std::move(inds)),std::move(TT.store()),TT.scale());
+    }
+
+template<class Tensor>
+typename GateCache<Tensor>::GateT GateCache<Tensor>::
+gate(int i1, int i2,
+     Real tau,
+     Tensor const& hh,
+     std::string const& type)
+    {
+    if(i2 != i1+1) Error("GateCache only holds gates on neighboring sites");
+
+    auto h = (i1 == 1 ? hh : moveSites(hh,sites_,i1,i2,1,2));
+
+    Entry const* found = nullptr;
+    for(auto& e : entries_)
+        {
+        if(e.tau == tau && e.type == type && norm(e.h-h) < 1E-12)
+            {
+            found = &e;
+            break;
+            }
+        }
+    if(!found)
+        {
+        auto G = GateT(sites_,1,2,GateT::tImag,tau,h);
+        entries_.push_back(Entry{tau,type,h,G.gate()});
+        found = &entries_.back();
+        }
+
+    if(i1 == 1) return GateT(sites_,1,2,found->g);
+    return GateT(sites_,i1,i2,moveSites(found->g,sites_,1,2,i1,i2));
+    }
+
+} //namespace itensor
+
+#endif //__GATECACHE_H
@@ -0,0 +1,30 @@
+#ifndef __INPUTLIST_H
+#define __INPUTLIST_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+namespace itensor {
+
+//
+// Parse a comma separated list of real numbers,
+// such as the input "betas = 0.5,1,2,4"
+//
+inline std::vector<Real>
+parseRealList(std::string const& str)
+    {
+    auto res = std::vector<Real>();
+    std::istringstream ss(str);
+    std::string tok;
+    while(std::getline(ss,tok,','))
+        {
+        if(tok.find_first_not_of(" \t") == std::string::npos) continue;
+        res.push_back(std::stod(tok));
+        }
+    return res;
+    }
+
+} //namespace itensor
+
+#endif //__INPUTLIST_H
@@ -0,0 +1,123 @@
+#ifndef __LOCAL_ENERGY_H
+#define __LOCAL_ENERGY_H
+
+#include <algorithm>
+#include "itensor/mps/mps.h"
+
+namespace itensor {
+
+//
+// XXZ bond Jz Sz_s1 Sz_s2 + Jxy/2 (S+_s1 S-_s2 + S-_s1 S+_s2)
+// between MPS sites s1 < s2
+//
+struct BondTerm
+    {
+    int s1 = 0,
+        s2 = 0;
+    Real Jz = 1,
+         Jxy = 1;
+    };
+
+//
+// Energy <psi|H|psi>/<psi|psi> of the sum of the bond terms,
+// from the bond correlations of psi in canonical form.
+//
+// The bonds are grouped by their first site a. With the
+// orthogonality center at a, the environments to the left of a
+// and to the right of any site b > a are identities, so every
+// bond (a,b) only needs the transfer matrices of sites a..b,
+// and all bonds starting at a share them. The center moves from
+// one site a to the next, so only one sweep is done in total.
+// The cost is of order N * (bond range) * m^3, without the
+// MPO bond dimension of overlap(psi,H,psi).
+//
+// psi is taken by value, so the gauge of the caller's MPS is
+// unchanged (its tensors are shared, not copied).
+//
+template<class Tensor>
+Real
+localEnergy(MPSt<Tensor> psi,
+            std::vector<BondTerm> bonds);
+
+
+//
+// Implementations
+//
+
+template<class Tensor>
+Real
+localEnergy(MPSt<Tensor> psi,
+            std::vector<BondTerm> bonds)
+    {
+    if(bonds.empty()) return 0;
+    auto const& sites = psi.sites();
+    auto N = psi.N();
+
+    for(auto& b : bonds) if(b.s1 > b.s2) std::swap(b.s1,b.s2);
+    std::sort(bonds.begin(),bonds.end(),[](BondTerm const& x, BondTerm const& y) { return x.s1 < y.s1; });
+
+    auto link = [&psi](int j) { return commonIndex(psi.A(j),psi.A(j+1),Link); };
+
+    //First operator of each term, the matching second
+    //operator and the coupling factor for Jz, Jxy
+    struct Term
+        {
+        std::string op1, op2;
+        Real fz, fxy;
+        };
+    auto terms = std::vector<Term>{{"Sz","Sz",1,0},{"S+","S-",0,0.5},{"S-","S+",0,0.5}};
+
+    Real E = 0;
+    Real nrm2 = -1;
+    auto b = bonds.begin();
+    while(b != bonds.end())
+        {
+        auto a = b->s1;
+        auto last = b;
+        int maxb = 0;
+        while(last != bonds.end() && last->s1 == a)
+            {
+            maxb = std::max(maxb,last->s2);
+            ++last;
+            }
+
+        psi.position(a);
+        if(nrm2 < 0) nrm2 = sqr(norm(psi.A(a)));
+
+        //Environments with op1 at a, open on the right link of a
+        auto env = std::vector<Tensor>();
+        for(auto& t : terms)
+            {
+            auto K = noprime(psi.A(a)*sites.op(t.op1,a),Site);
+            env.push_back(K*dag(prime(psi.A(a),link(a))));
+            }
+
+        for(int j = a+1; j <= maxb; ++j)
+            {
+            auto bra_close = (j < N ? dag(prime(psi.A(j),link(j-1))) : dag(prime(psi.A(j),Link)));
+            for(auto c = b; c != last; ++c)
+                {
+                if(c->s2 != j) continue;
+                for(auto k : range(terms))
+                    {
+                    auto f = terms[k].fz*c->Jz+terms[k].fxy*c->Jxy;
+                    if(f == 0) continue;
+                    auto K = noprime(psi.A(j)*sites.op(terms[k].op2,j),Site);
+                    E += f*(env[k]*K*bra_close).cplx().real();
+                    }
+                }
+            if(j < maxb)
+                {
+                auto T = psi.A(j)*dag(prime(psi.A(j),Link));
+                for(auto& e : env) e *= T;
+                }
+            }
+        b = last;
+        }
+
+    return E/nrm2;
+    }
+
+} //namespace itensor
+
+#endif //__LOCAL_ENERGY_H
@@ -0,0 +1,230 @@
+#include <deque>
+#include <list>
+#include <future>
+#include "itensor/all.h"
+#include "S2.h"
+#include "snapshot.h"
+#include "correlations.h"
+#include "expect.h"
+
+using namespace std;
+using namespace itensor;
+
+//
+// MPOs to measure, built for one site set
+//
+struct SnapshotObservables
+    {
+    SpinHalf sites;
+    std::vector<std::string> names;
+    std::vector<IQMPO> mpos;
+    //Copies of the site tensors of the MPOs, made on the main
+    //thread: the MPO accessors are not safe to call concurrently
+    std::vector<std::vector<IQTensor>> tensors;
+    };
+
+struct SnapshotResult
+    {
+    std::string file;
+    SnapshotInfo info;
+    std::vector<Real> values;
+    std::vector<Real> corr;
+    };
+
+int
+main(int argc, char* argv[])
+    {
+    if(argc != 2)
+        {
+        printfln("Usage: %s inputfile.",argv[0]);
+        return 0;
+        }
+    auto input = InputGroup(argv[1],"input");
+
+    auto snapshot_list = input.getString("snapshots");
+    auto outfile = input.getString("outfile","measure.dat");
+    auto corrfile = input.getString("corrfile","corr.dat");
+    auto nthreads = input.getInt("nthreads",1);
+
+    auto Nx = input.getInt("Nx",10);
+    auto Ny = input.getInt("Ny",1);
+    auto periodic = input.getYesNo("periodic",true);
+    auto lattice_type = input.getString("lattice_type","triangular");
+    auto Jz = input.getReal("Jz",1.);
+    auto Jxy = input.getReal("Jxy",1.);
+    auto hz = input.getReal("hz",0.);
+
+    //Snapshots of purified states written by mpo_ancilla
+    auto ancilla = input.getYesNo("ancilla",false);
+
+    auto do_energy = input.getYesNo("energy",true);
+    auto do_S2 = input.getYesNo("S2",true);
+    auto do_Sxy2 = input.getYesNo("Sxy2",false);
+    auto do_Sz2 = input.getYesNo("Sz2",false);
+
+    //Measure <Sz_i Sz_j> for physical site i=corr_site if nonzero
+    auto corr_site = input.getInt("corr_site",0);
+
+    auto N = Nx*Ny;
+
+    Args args;
+    args.add("Ny",Ny);
+    args.add("YPeriodic",periodic);
+    args.add("SkipAncilla",ancilla);
+
+    LatticeGraph lattice;
+    if(lattice_type == "triangular")
+        lattice = triangularLattice(Nx,Ny,args);
+    else if(lattice_type == "square")
+        lattice = squareLattice(Nx,Ny,args);
+
+    //Map physical site number to MPS site number
+    auto phys = [ancilla](int j) { return ancilla ? 2*j-1 : j; };
+
+    auto makeObservables = [&](SpinHalf const& sites)
+        {
+        auto obs = SnapshotObservables();
+        obs.sites = sites;
+        if(do_energy)
+            {
+            auto ampo = AutoMPO(sites);
+            for(auto b : lattice)
+                {
+                auto s1 = phys(b.s1),
+                     s2 = phys(b.s2);
+                ampo += (0.5*Jxy),"S+",s1,"S-",s2;
+                ampo += (0.5*Jxy),"S-",s1,"S+",s2;
+                ampo +=        Jz,"Sz",s1,"Sz",s2;
+                }
+            for(int j = 1; j <= N; ++j)
+                {
+                if(hz != 0.0) ampo += -hz,"Sz",phys(j);
+                }
+            obs.names.push_back("E/N");
+            obs.mpos.push_back(IQMPO(ampo));
+            }
+        if(do_S2)
+            {
+            obs.names.push_back("S2");
+            obs.mpos.push_back(makeS2(sites,args));
+            }
+        if(do_Sxy2)
+            {
+            obs.names.push_back("Sxy2");
+            obs.mpos.push_back(makeSxy2(sites,args));
+            }
+        if(do_Sz2)
+            {
+            obs.names.push_back("Sz2");
+            obs.mpos.push_back(makeTotSz2(sites,args));
+            }
+        auto Ws = std::vector<IQMPO const*>();
+        for(auto& W : obs.mpos) Ws.push_back(&W);
+        obs.tensors = mpoSiteTensors(Ws);
+        return obs;
+        };
+
+    auto measure = [&](std::string file, SnapshotInfo info, IQMPS psi, SnapshotObservables const* obs)
+        {
+        auto res = SnapshotResult();
+        res.file = file;
+        res.info = info;
+        auto nrm2 = overlap(psi,psi);
+        auto vals = expectMPOTensors(psi,obs->tensors,{"Threads",1});
+        for(auto k : range(vals))
+            {
+            auto val = vals.at(k)/nrm2;
+            if(obs->names.at(k) == "E/N") val /= N;
+            res.values.push_back(val);
+            }
+        if(corr_site > 0)
+            {
+            auto js = std::vector<int>();
+            for(int j = 1; j <= N; ++j) js.push_back(phys(j));
+            res.corr = correlations(psi,"Sz",phys(corr_site),"Sz",js);
+            }
+        return res;
+        };
+
+    auto files = std::vector<std::string>();
+    std::ifstream lf(snapshot_list);
+    if(!lf) Error("Could not open list of snapshots " + snapshot_list);
+    std::string line;
+    while(std::getline(lf,line))
+        {
+        if(line.find_first_not_of(" \t") != std::string::npos) files.push_back(line);
+        }
+    printfln("Measuring %d snapshots on %d threads",files.size(),nthreads);
+
+    std::ofstream outf(outfile);
+    std::ofstream corrf;
+    if(corr_site > 0) corrf.open(corrfile);
+
+    //One set of observables per distinct site set,
+    //held in a list so pointers to them stay valid
+    std::list<SnapshotObservables> obsets;
+    std::vector<Stats> stats;
+
+    auto writeResult = [&](SnapshotResult const& r)
+        {
+        outf << format("%s %.10f %d",r.file,r.info.beta,r.info.step);
+        for(auto k : range(r.values))
+            {
+            outf << format(" %.14f",r.values.at(k));
+            stats.at(k).putin(r.values.at(k));
+            }
+        outf << "\n";
+        for(auto j : range(r.corr))
+            {
+            corrf << format("%s %d %d %.14f\n",r.file,corr_site,j+1,r.corr.at(j));
+            }
+        };
+
+    //
+    // Snapshots are read on the main thread and measured on worker
+    // threads, with at most nthreads measurements in flight.
+    // Results are written in the order of the list of snapshots.
+    //
+    std::deque<std::future<SnapshotResult>> pending;
+    for(auto& file : files)
+        {
+        auto sites = readSnapshotSites<SpinHalf>(file);
+        if(obsets.empty() || !(obsets.back().sites(1) == sites(1)))
+            {
+            obsets.push_back(makeObservables(sites));
+            if(stats.empty())
+                {
+                stats.resize(obsets.back().names.size());
+                outf << "# file beta step";
+                for(auto& name : obsets.back().names) outf << " " << name;
+                outf << "\n";
+                }
+            }
+
+        auto info = SnapshotInfo();
+        auto psi = readSnapshot<IQTensor>(file,obsets.back().sites,&info);
+
+        if(int(pending.size()) >= nthreads)
+            {
+            writeResult(pending.front().get());
+            pending.pop_front();
+            }
+        pending.push_back(std::async(std::launch::async,measure,file,info,std::move(psi),&obsets.back()));
+        }
+    while(!pending.empty())
+        {
+        writeResult(pending.front().get());
+        pending.pop_front();
+        }
+
+    println("\nAverages over snapshots:");
+    if(!obsets.empty())
+        {
+        for(auto k : range(stats))
+            {
+            printfln("%s = %.14f %.3E",obsets.front().names.at(k),stats.at(k).avg(),stats.at(k).err());
+            }
+        }
+
+    return 0;
+    }
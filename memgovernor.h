@@ -0,0 +1,217 @@
+#ifndef __MEMGOVERNOR_H
+#define __MEMGOVERNOR_H
+
+#include "itensor/mps/mps.h"
+#include "mempool.h"
+
+namespace itensor {
+
+//
+// Lowers the maximum bond dimension so that the estimated memory
+// use of a time evolution stays within a budget, instead of
+// letting the job run out of memory.
+//
+// The memory use at maximum bond dimension m is estimated as
+//   (memory in use when the governor is made)
+//   + MPS with every bond at dimension m (or its exact maximum)
+//   + temporaries of one bond update, TempFactor*(d*k*m)^2 numbers,
+// where k is the bond dimension of the MPO applied (1 for gates).
+// The two-site wavefunction, the SVD factors and the LAPACK
+// workspace make up TempFactor, about 6.
+//
+// The baseline is taken once, before the evolution starts: later on
+// the resident memory also holds the temporaries of the previous step,
+// which the estimate already counts, and memory freed but kept by
+// malloc or the memory pool, so it would only grow from step to step
+// and the maximum bond dimension would be lowered over and over.
+// Since the estimate only depends on the sites of psi, the largest
+// m within the budget, the cap, is computed once, at the first call
+// of limit, and the evolution runs with it from its first step.
+//
+// When the cap is below the requested maxm, the truncation it causes
+// is printed by report, from the discarded weight the evolver found
+// (see TStateObserver::truncErr), or by reportKept from the smallest
+// weight kept at the bonds at the cap for evolvers which do not
+// return their discarded weight.
+//
+// Recognized args of the constructor:
+//   "Maxm"       requested maximum bond dimension
+//   "MinMaxm"    never lower the maximum below this (default 10)
+//   "MPOLinkDim" bond dimension k of the MPO applied (default 1)
+//   "Complex"    whether the MPS is complex (default false)
+//   "TempFactor" (default 6)
+//   "Baseline"   memory in use before the evolution, in MB
+//                (default: the resident memory now)
+//
+class MemoryGovernor
+    {
+    public:
+
+    //budget in MB, a budget <= 0 disables the governor
+    MemoryGovernor(Real budget,
+                   Args const& args = Global::args());
+
+    bool
+    enabled() const { return budget_ > 0; }
+
+    //Estimated memory use in MB at maximum bond dimension m
+    template<class Tensor>
+    Real
+    estimate(MPSt<Tensor> const& psi,
+             long m) const;
+
+    //
+    // Set "Maxm" in args to the cap, the largest bond dimension
+    // within the budget, computed at the first call.
+    // Returns the maximum bond dimension set.
+    //
+    template<class Tensor>
+    long
+    limit(MPSt<Tensor> const& psi,
+          Args& args);
+
+    //Whether the cap is below the requested maxm
+    bool
+    capped() const { return cap_ > 0 && cap_ < maxm_; }
+
+    //Print the weight discarded by an evolution at the cap
+    void
+    report(Real discarded) const;
+
+    //Print the largest weight at the truncation point of the
+    //bonds at the cap, found by an SVD sweep of psi which leaves
+    //it centered at site 1
+    template<class Tensor>
+    void
+    reportKept(MPSt<Tensor>& psi) const;
+
+    private:
+
+    Real budget_ = 0,
+         baseline_ = 0;
+    long maxm_ = 0,
+         minmaxm_ = 0,
+         k_ = 1;
+    Real bytes_ = 8,
+         temp_factor_ = 6;
+    long cap_ = 0;
+    };
+
+
+//
+// Implementations
+//
+
+inline MemoryGovernor::
+MemoryGovernor(Real budget,
+               Args const& args)
+  : budget_(budget),
+    maxm_(args.getInt("Maxm")),
+    minmaxm_(args.getInt("MinMaxm",10)),
+    k_(args.getInt("MPOLinkDim",1)),
+    bytes_(args.getBool("Complex",false) ? 16 : 8),
+    temp_factor_(args.getReal("TempFactor",6))
+    {
+    baseline_ = args.getReal("Baseline",memoryUsage().rss);
+    }
+
+template<class Tensor>
+Real MemoryGovernor::
+estimate(MPSt<Tensor> const& psi,
+         long m) const
+    {
+    auto N = psi.N();
+    auto const& sites = psi.sites();
+    auto MB = 1./(1024.*1024.);
+
+    //Bond dimension of bond b at maximum m
+    auto exact = std::vector<Real>(N+1,1.);
+    for(int b = 1; b < N; ++b) exact.at(b) = exact.at(b-1)*sites(b).m();
+    auto right = 1.;
+    for(int b = N-1; b >= 1; --b)
+        {
+        right *= sites(b+1).m();
+        exact.at(b) = std::min(exact.at(b),right);
+        }
+    exact.at(N) = 1;
+    auto atm = [&exact,m](int b) -> Real { return std::min(Real(m),exact.at(b)); };
+
+    Real psi_m = 0;
+    long d = 1;
+    for(int n = 1; n <= N; ++n)
+        {
+        d = std::max(d,sites(n).m());
+        psi_m += atm(n-1)*sites(n).m()*atm(n);
+        }
+    auto temp = temp_factor_*std::pow(Real(d*k_*m),2);
+
+    return baseline_+(psi_m+temp)*bytes_*MB;
+    }
+
+template<class Tensor>
+long MemoryGovernor::
+limit(MPSt<Tensor> const& psi,
+      Args& args)
+    {
+    if(!enabled()) return maxm_;
+    if(cap_ > 0)
+        {
+        args.add("Maxm",cap_);
+        return cap_;
+        }
+
+    //Largest m within the budget, by bisection
+    long lo = minmaxm_,
+         hi = maxm_;
+    if(estimate(psi,hi) <= budget_)
+        {
+        lo = hi;
+        }
+    else
+        {
+        while(hi-lo > 1)
+            {
+            auto mid = (lo+hi)/2;
+            if(estimate(psi,mid) <= budget_) lo = mid;
+            else                             hi = mid;
+            }
+        }
+    cap_ = lo;
+    args.add("Maxm",cap_);
+
+    if(capped())
+        {
+        printfln("Memory governor: budget %.0f MB, maxm %d -> %d (estimated %.0f MB)",
+                 budget_,maxm_,cap_,estimate(psi,cap_));
+        if(estimate(psi,cap_) > budget_) println("Memory governor: warning, estimate exceeds budget at the minimum maxm");
+        }
+    return cap_;
+    }
+
+void inline MemoryGovernor::
+report(Real discarded) const
+    {
+    if(!capped()) return;
+    printfln("Memory governor: maxm %d (instead of %d), discarded weight %.3E",cap_,maxm_,discarded);
+    }
+
+template<class Tensor>
+void MemoryGovernor::
+reportKept(MPSt<Tensor>& psi) const
+    {
+    if(!capped()) return;
+    Real smallest = 0;
+    psi.position(psi.N());
+    for(int b = psi.N()-1; b >= 1; --b)
+        {
+        auto AA = psi.A(b)*psi.A(b+1);
+        auto spec = psi.svdBond(b,AA,Fromright,{"Cutoff",0.});
+        if(spec.numEigsKept() >= cap_) smallest = std::max(smallest,spec.eig(spec.numEigsKept()));
+        }
+    printfln("Memory governor: maxm %d (instead of %d), largest smallest kept weight at the capped bonds %.3E",
+             cap_,maxm_,smallest);
+    }
+
+} //namespace itensor
+
+#endif //__MEMGOVERNOR_H
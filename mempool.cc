@@ -0,0 +1,187 @@
+//
+// Global operator new and delete of the programs, with the pool of
+// large blocks declared in mempool.h. Replacement allocation functions
+// may not be inline, so unlike the rest of the code they are defined
+// here and linked into every program (see Makefile.default).
+//
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include "mempool.h"
+
+namespace itensor {
+
+namespace {
+
+//Header in front of every block, keeping 16 byte alignment.
+//cls is the size class + 1 of pooled blocks, 0 for others.
+struct alignas(16) BlockHeader
+    {
+    size_t cls;
+    size_t bytes;
+    };
+
+//Size classes 2^e (1 + q/4), q = 0..3
+const int nclass = 4*64+1;
+
+//Only touched under pool_mutex. The free blocks are kept in
+//singly linked lists stored in the blocks themselves, so the
+//pool never allocates memory of its own.
+std::mutex pool_mutex;
+void* free_list[nclass] = {};
+size_t cached_bytes = 0;
+
+std::atomic<bool> pool_on(false);
+std::atomic<size_t> pool_min(64*1024);
+std::atomic<size_t> pool_max(size_t(4096)*1024*1024);
+
+std::atomic<long> nlarge(0);
+std::atomic<long> nreused(0);
+std::atomic<long long> large_ns(0);
+
+int
+sizeClass(size_t n,
+          size_t& rounded)
+    {
+    int e = 63-__builtin_clzll(n);
+    size_t step = size_t(1) << (e-2);
+    size_t q = (n-(size_t(1) << e)+step-1)/step;
+    rounded = (size_t(1) << e)+q*step;
+    return 4*e+int(q);
+    }
+
+long long
+nanoseconds()
+    {
+    using namespace std::chrono;
+    return duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+void*
+allocate(size_t n)
+    {
+    if(n < pool_min)
+        {
+        auto h = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader)+n));
+        if(!h) return nullptr;
+        h->cls = 0;
+        h->bytes = n;
+        return h+1;
+        }
+
+    auto t0 = nanoseconds();
+    ++nlarge;
+    size_t bytes = n;
+    int cls = -1;
+    if(pool_on)
+        {
+        cls = sizeClass(n,bytes);
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if(auto p = free_list[cls])
+            {
+            free_list[cls] = *static_cast<void**>(p);
+            cached_bytes -= bytes;
+            ++nreused;
+            large_ns += nanoseconds()-t0;
+            return p;
+            }
+        }
+    auto h = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader)+bytes));
+    if(h)
+        {
+        h->cls = cls+1;
+        h->bytes = bytes;
+        }
+    large_ns += nanoseconds()-t0;
+    return h ? h+1 : nullptr;
+    }
+
+void
+deallocate(void* p)
+    {
+    if(!p) return;
+    auto h = static_cast<BlockHeader*>(p)-1;
+    if(h->bytes < pool_min)
+        {
+        std::free(h);
+        return;
+        }
+    auto t0 = nanoseconds();
+    if(h->cls > 0 && pool_on)
+        {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if(cached_bytes+h->bytes <= pool_max)
+            {
+            *static_cast<void**>(p) = free_list[h->cls-1];
+            free_list[h->cls-1] = p;
+            cached_bytes += h->bytes;
+            large_ns += nanoseconds()-t0;
+            return;
+            }
+        }
+    std::free(h);
+    large_ns += nanoseconds()-t0;
+    }
+
+void*
+allocateOrThrow(size_t n)
+    {
+    auto p = allocate(n);
+    if(!p) throw std::bad_alloc();
+    return p;
+    }
+
+} //namespace
+
+bool
+startPool(size_t min_bytes,
+          size_t max_bytes)
+    {
+    bool off = false;
+    if(!pool_on.compare_exchange_strong(off,true)) return false;
+    pool_min = min_bytes;
+    pool_max = max_bytes;
+    return true;
+    }
+
+void
+stopPool()
+    {
+    pool_on = false;
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for(auto& head : free_list)
+        {
+        while(head)
+            {
+            auto p = head;
+            head = *static_cast<void**>(p);
+            std::free(static_cast<BlockHeader*>(p)-1);
+            }
+        }
+    cached_bytes = 0;
+    }
+
+AllocationStats
+allocationStats()
+    {
+    auto st = AllocationStats();
+    st.large = nlarge;
+    st.reused = nreused;
+    st.seconds = large_ns*1E-9;
+    return st;
+    }
+
+} //namespace itensor
+
+void* operator new(size_t n) { return itensor::allocateOrThrow(n); }
+void* operator new[](size_t n) { return itensor::allocateOrThrow(n); }
+void* operator new(size_t n, std::nothrow_t const&) noexcept { return itensor::allocate(n); }
+void* operator new[](size_t n, std::nothrow_t const&) noexcept { return itensor::allocate(n); }
+void operator delete(void* p) noexcept { itensor::deallocate(p); }
+void operator delete[](void* p) noexcept { itensor::deallocate(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { itensor::deallocate(p); }
+void operator delete[](void* p, std::nothrow_t const&) noexcept { itensor::deallocate(p); }
+void operator delete(void* p, size_t) noexcept { itensor::deallocate(p); }
+void operator delete[](void* p, size_t) noexcept { itensor::deallocate(p); }
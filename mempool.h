@@ -0,0 +1,200 @@
+#ifndef __MEMPOOL_H
+#define __MEMPOOL_H
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "itensor/util/print_macro.h"
+#include "itensor/util/args.h"
+
+namespace itensor {
+
+//
+// Pooled reuse of tensor memory.
+//
+// ITensor allocates tensor storage through std::vector with the
+// default allocator, so the pool works at the level of the global
+// operator new and delete, which mempool.cc replaces. While a
+// MemoryPool object is active, freed blocks of at least "PoolMinKB"
+// are not returned to malloc but kept in free lists by size class,
+// with sizes rounded up to 2^e (1 + q/4), q = 0..3, and the next
+// request of the same class takes a block from its list. The sizes
+// of the two-site wavefunctions, SVD workspaces and toITensor copies
+// repeat from one Trotter step or METTS to the next, so after the
+// first steps nearly every large block is reused: no page faults,
+// no system calls, and no fragmentation of the heap by blocks of
+// slightly different sizes. The lists are protected by one mutex,
+// held only to push or pop a block, so threads keep their own malloc
+// arenas for everything else.
+//
+// When the MemoryPool ends (at end() or its destructor) the cached
+// blocks are freed, the malloc settings are restored and the heap is
+// trimmed, so the memory is returned to the system after the loop.
+//
+// The number of large allocations, how many of them were served from
+// the pool, and the time spent allocating and freeing large blocks
+// are counted with or without a pool (see allocationStats), so runs
+// with and without the pool can be compared.
+//
+// Recognized args:
+//   "MemoryPool" (default false): whether the pool is used
+//   "PoolMinKB"  (default 64): smallest block kept by the pool
+//   "PoolMaxMB"  (default 4096): most memory held in free blocks
+//   "PoolTopPad" (default 64): MB requested from the system each
+//                time the heap grows, while the pool is active
+//
+class MemoryPool
+    {
+    public:
+
+    explicit
+    MemoryPool(Args const& args = Global::args());
+
+    ~MemoryPool() { end(); }
+
+    MemoryPool(MemoryPool const&) = delete;
+    MemoryPool& operator=(MemoryPool const&) = delete;
+
+    bool
+    active() const { return active_; }
+
+    //Stop pooling, release the cached blocks and print
+    //the allocation statistics of the pooled period
+    void
+    end();
+
+    private:
+
+    bool active_ = false;
+    Real start_seconds_ = 0;
+    long start_large_ = 0,
+         start_reused_ = 0;
+    };
+
+struct AllocationStats
+    {
+    long large = 0,  //allocations of large blocks
+         reused = 0; //of these, served from the pool
+    Real seconds = 0; //time allocating and freeing large blocks
+    };
+
+AllocationStats
+allocationStats();
+
+//Defined in mempool.cc
+bool
+startPool(size_t min_bytes,
+          size_t max_bytes);
+
+void
+stopPool();
+
+struct MemoryUsage
+    {
+    Real rss = 0;  //resident memory now, MB
+    Real peak = 0; //peak resident memory, MB
+    };
+
+MemoryUsage
+memoryUsage();
+
+//
+// Records the resident memory after each iteration of a loop and
+// reports the peak and the steady state, i.e. the mean over the
+// second half of the iterations, together with its drift
+//
+class MemoryTracker
+    {
+    public:
+
+    void
+    sample() { rss_.push_back(memoryUsage().rss); }
+
+    void
+    report(std::string const& name) const;
+
+    private:
+
+    std::vector<Real> rss_;
+    };
+
+
+//
+// Implementations
+//
+
+inline MemoryPool::
+MemoryPool(Args const& args)
+    {
+    if(!args.getBool("MemoryPool",false)) return;
+    auto min_bytes = size_t(args.getReal("PoolMinKB",64)*1024);
+    auto max_bytes = size_t(args.getReal("PoolMaxMB",4096)*1024*1024);
+    active_ = startPool(min_bytes,max_bytes);
+    if(!active_) return;
+#ifdef __GLIBC__
+    mallopt(M_TOP_PAD,int(args.getReal("PoolTopPad",64)*1024*1024));
+#endif
+    auto st = allocationStats();
+    start_seconds_ = st.seconds;
+    start_large_ = st.large;
+    start_reused_ = st.reused;
+    }
+
+inline void MemoryPool::
+end()
+    {
+    if(!active_) return;
+    active_ = false;
+    stopPool();
+#ifdef __GLIBC__
+    //glibc default, 128KB
+    mallopt(M_TOP_PAD,128*1024);
+    malloc_trim(0);
+#endif
+    auto st = allocationStats();
+    auto nlarge = st.large-start_large_;
+    printfln("Memory pool: %d large allocations, %.1f%% reused, %.3f s allocating large blocks",
+             nlarge,100.*(st.reused-start_reused_)/std::max(1L,nlarge),st.seconds-start_seconds_);
+    }
+
+inline MemoryUsage
+memoryUsage()
+    {
+    auto mu = MemoryUsage();
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF,&ru) == 0) mu.peak = ru.ru_maxrss/1024.;
+
+    std::ifstream f("/proc/self/statm");
+    long size = 0, resident = 0;
+    if(f >> size >> resident) mu.rss = resident*(sysconf(_SC_PAGESIZE)/(1024.*1024.));
+    return mu;
+    }
+
+inline void MemoryTracker::
+report(std::string const& name) const
+    {
+    auto mu = memoryUsage();
+    auto st = allocationStats();
+    printfln("%s allocations: %d large blocks, %.3f s allocating large blocks",name,st.large,st.seconds);
+    if(rss_.empty())
+        {
+        printfln("%s memory: peak %.1f MB",name,mu.peak);
+        return;
+        }
+    auto half = rss_.size()/2;
+    Real steady = 0;
+    for(auto j = half; j < rss_.size(); ++j) steady += rss_[j];
+    steady /= (rss_.size()-half);
+    auto drift = rss_.back()-rss_.at(half);
+    printfln("%s memory: peak %.1f MB, steady state %.1f MB (drift %.1f MB over last %d iterations)",
+             name,mu.peak,steady,drift,rss_.size()-half);
+    }
+
+} //namespace itensor
+
+#endif //__MEMPOOL_H
@@ -0,0 +1,380 @@
+#ifndef __METTS_H
+#define __METTS_H
+
+#include <future>
+#include "itensor/all.h"
+#include "collapse.h"
+#include "TStateObserver.h"
+#include "snapshot.h"
+#include "mempool.h"
+#include "expect.h"
+
+namespace itensor {
+
+//
+// MPOs measured on each METTS
+//
+struct METTSMPOs
+    {
+    IQMPO H,
+          H2,
+          S2,
+          Sxy2,
+          Sz2;
+    };
+
+//
+// Running averages over the METTS of one chain
+//
+struct METTSStats
+    {
+    Stats en,
+          en2,
+          s2,
+          sxy2,
+          cpu;
+    };
+
+//
+// Measured values of a single METTS
+//
+struct METTSMeasurement
+    {
+    int num = 0;
+    Real cpu = 0,
+         en = 0,
+         en2 = 0,
+         s2 = 0,
+         sxy2 = 0;
+    };
+
+//
+// Generate nwarm+nmetts METTS at inverse temperature beta and
+// measure all but the first nwarm of them.
+// The evolver is called as evolve(psi) and should evolve the
+// collapsed product state psi in imaginary time by beta/2.
+// On return psi is the last collapsed product state, which is
+// a good starting point for a chain at a nearby temperature.
+//
+// If the argument "Pipeline" is true, each METTS is measured on a
+// worker thread using a copy of psi while the main thread collapses
+// it and evolves the next one. At most one copy is outstanding and
+// results enter the stats in the order the METTS were made.
+//
+// Otherwise, unless the argument "FuseCollapse" is false, each METTS
+// is measured and collapsed in a single pass (see measureAndCollapse).
+//
+// The MPOs are measured on "MeasureThreads" threads (default 1) with
+// expectMPOs, which splits each contraction into two halves.
+//
+// If the argument "SnapshotEvery" is k > 0, every k-th measured
+// METTS is written to a snapshot file whose name starts with
+// "SnapshotPrefix".
+//
+// The resident memory is recorded after each step, and its
+// peak and steady state value are printed at the end. The loop
+// runs within a MemoryPool (see mempool.h), active if the
+// argument "MemoryPool" is true.
+//
+template<class Evolver>
+void
+runMETTS(IQMPS& psi,
+         Evolver&& evolve,
+         METTSMPOs const& mpos,
+         BasisPtr<IQTensor> const& basis,
+         Real beta,
+         int nwarm,
+         int nmetts,
+         METTSStats& stats,
+         Args args = Global::args());
+
+//
+// Write one line of averages per site for inverse temperature beta:
+// beta, energy, specific heat, susceptibility, XY susceptibility
+// (each followed by its error bar) and the number of samples
+//
+void
+writeStats(std::ostream& s,
+           Real beta,
+           int N,
+           int nmetts,
+           METTSStats const& stats);
+
+METTSMeasurement
+measureMETTS(IQMPS const& psi,
+             METTSMPOs const& mpos,
+             Args const& args = Global::args());
+
+//
+// Measure the MPOs on psi and collapse it into a product state
+// in the same left to right pass: site j of psi is contracted into
+// the environments of all MPOs, then sampled and replaced by its
+// product state. Each site tensor is thus read once, and the only
+// gauge sweep is psi.position(1), which costs nothing when the
+// evolution already left psi centered at site 1. The sampled states
+// are returned in state, as by collapse.
+//
+// If "MeasureThreads" is more than 1, the MPOs are instead measured
+// by measureMETTS on a copy of psi, which shares its storage, on
+// that many threads while the calling thread collapses psi in the
+// same single pass, without building the environments. The copy is
+// made after psi.position(1), so psi is gauged only once.
+//
+METTSMeasurement
+measureAndCollapse(IQMPS& psi,
+                   METTSMPOs const& mpos,
+                   BasisPtr<IQTensor> const& basis,
+                   std::vector<int>& state,
+                   Args const& args = Global::args());
+
+//
+// Add a measurement to the running averages
+// and print the updated averages
+//
+void
+recordMETTS(METTSMeasurement const& m,
+            METTSStats& stats,
+            Real beta,
+            int N);
+
+
+//
+// Implementations
+//
+
+template<class Evolver>
+void
+runMETTS(IQMPS& psi,
+         Evolver&& evolve,
+         METTSMPOs const& mpos,
+         BasisPtr<IQTensor> const& basis,
+         Real beta,
+         int nwarm,
+         int nmetts,
+         METTSStats& stats,
+         Args args)
+    {
+    auto N = psi.N();
+    bool verbose = true;
+    auto pipeline = args.getBool("Pipeline",false);
+    auto fuse = args.getBool("FuseCollapse",true);
+    auto snapshot_every = args.getInt("SnapshotEvery",0);
+    auto snapshot_prefix = args.getString("SnapshotPrefix","metts");
+
+    //Measurement of the previous METTS still running
+    std::future<METTSMeasurement> pending;
+
+    auto memory = MemoryTracker();
+    MemoryPool pool(args);
+
+    for(int step = 1; step <= (nwarm+nmetts); ++step)
+        {
+        psi.position(1);
+        args.add("Step",step);
+
+        if(verbose)
+            {
+            if (step <= nwarm)
+                printfln("\nStarting step %d (warmup %d/%d)",step,step,nwarm);
+            else
+                printfln("\nMaking METTS number %d/%d",step-nwarm,nmetts);
+            }
+
+        auto cpu_time_1s = cpu_mytime();
+        evolve(psi);
+        auto cpu_time_1e = cpu_mytime();
+        printfln("CPU time for generation of METTS %.14f",cpu_time_1e - cpu_time_1s);
+
+
+        if(step > nwarm) println("\nDone making METTS ",step-nwarm);
+
+        if(step > nwarm && snapshot_every > 0 && (step-nwarm)%snapshot_every == 0)
+            {
+            auto fname = format("%s_b%.4f_%06d.snp",snapshot_prefix,beta,step-nwarm);
+            writeSnapshot(fname,psi,{"Beta",beta,"Step",step-nwarm});
+            }
+
+        auto cps = std::vector<int>();
+        if(step > nwarm)
+            {
+            if(pipeline)
+                {
+                if(pending.valid()) recordMETTS(pending.get(),stats,beta,N);
+                auto measure = [&mpos,args](IQMPS snapshot, int num, Real cpu)
+                    {
+                    auto m = measureMETTS(snapshot,mpos,args);
+                    m.num = num;
+                    m.cpu = cpu;
+                    return m;
+                    };
+                pending = std::async(std::launch::async,measure,psi,step-nwarm,cpu_time_1e-cpu_time_1s);
+                }
+            else if(fuse)
+                {
+                auto m = measureAndCollapse(psi,mpos,basis,cps,args);
+                m.num = step-nwarm;
+                m.cpu = cpu_time_1e-cpu_time_1s;
+                recordMETTS(m,stats,beta,N);
+                }
+            else
+                {
+                auto m = measureMETTS(psi,mpos,args);
+                m.num = step-nwarm;
+                m.cpu = cpu_time_1e-cpu_time_1s;
+                recordMETTS(m,stats,beta,N);
+                }
+            }
+
+        // Collapse into product state
+        if(cps.empty()) cps = collapse(psi,basis,args);
+        for(int j = 1; j <= N; ++j)
+            {
+            print(basis->statestr(j,cps[j],args)," ");
+            }
+        println();
+
+        memory.sample();
+        }
+
+    if(pending.valid()) recordMETTS(pending.get(),stats,beta,N);
+
+    pool.end();
+    memory.report("METTS");
+    }
+
+METTSMeasurement inline
+measureMETTS(IQMPS const& psi,
+             METTSMPOs const& mpos,
+             Args const& args)
+    {
+    auto vals = expectMPOs(psi,{&mpos.H,&mpos.H2,&mpos.S2,&mpos.Sxy2},
+                           {"Threads",args.getInt("MeasureThreads",1)});
+    auto m = METTSMeasurement();
+    m.en = vals.at(0);
+    m.en2 = vals.at(1);
+    m.s2 = vals.at(2);
+    m.sxy2 = vals.at(3);
+    return m;
+    }
+
+METTSMeasurement inline
+measureAndCollapse(IQMPS& psi,
+                   METTSMPOs const& mpos,
+                   BasisPtr<IQTensor> const& basis,
+                   std::vector<int>& state,
+                   Args const& args)
+    {
+    auto N = psi.N();
+    psi.position(1);
+    state.assign(N+1,0);
+    auto Aj = toITensor(psi.A(1));
+
+    if(args.getInt("MeasureThreads",1) > 1)
+        {
+        //Measure a copy of psi on the worker threads while psi,
+        //already centered at site 1, is collapsed on this thread
+        auto measured = std::async(std::launch::async,[&mpos,&args](IQMPS snapshot)
+            {
+            return measureMETTS(snapshot,mpos,args);
+            },psi);
+        for(int j = 1; j <= N; ++j)
+            {
+            state.at(j) = collapseSite(psi,basis,j,Aj,args);
+            }
+        return measured.get();
+        }
+
+    auto W = std::vector<IQMPO const*>{&mpos.H,&mpos.H2,&mpos.S2,&mpos.Sxy2};
+    auto L = std::vector<IQTensor>(W.size());
+    for(int j = 1; j <= N; ++j)
+        {
+        //Environments use site j before it is collapsed
+        auto A = psi.A(j);
+        auto Ad = dag(prime(A));
+        for(auto k : range(W))
+            {
+            L[k] = (j == 1 ? A*W[k]->A(j)*Ad : L[k]*A*W[k]->A(j)*Ad);
+            }
+        state.at(j) = collapseSite(psi,basis,j,Aj,args);
+        }
+
+    auto m = METTSMeasurement();
+    m.en = L[0].cplx().real();
+    m.en2 = L[1].cplx().real();
+    m.s2 = L[2].cplx().real();
+    m.sxy2 = L[3].cplx().real();
+    return m;
+    }
+
+void inline
+recordMETTS(METTSMeasurement const& m,
+            METTSStats& stats,
+            Real beta,
+            int N)
+    {
+    //
+    //CPU time
+    //
+    stats.cpu.putin(m.cpu);
+    printfln("Average CPU time = %.14f %.3E",stats.cpu.avg(),stats.cpu.err());
+
+    //
+    //Energy
+    //
+    stats.en.putin(m.en);
+    auto avgEn = stats.en.avg();
+    printfln("Energy of METTS %d = %.14f",m.num,m.en);
+    printfln("Average energy = %.14f %.3E",avgEn,stats.en.err());
+    printfln("Average energy per site = %.14f %.3E",avgEn/N,stats.en.err()/N);
+
+    //
+    //Specific heat
+    //
+    stats.en2.putin(m.en2);
+    auto avgEn2 = stats.en2.avg();
+    printfln("<H^2> for METTS %d = %.14f",m.num,m.en2);
+    printfln("Average specific heat = %.14f %.3E",(avgEn2-sqr(avgEn))*sqr(beta),stats.en2.err());
+    printfln("Average specific heat per site = %.14f %.3E",(avgEn2-sqr(avgEn))*sqr(beta)/N,stats.en2.err()/N);
+
+    //
+    //Susceptibility
+    //
+    stats.s2.putin(m.s2);
+    auto asus = (stats.s2.avg()*beta/3);
+    auto esus = (stats.s2.err()*beta/3);
+    printfln("<S^2> for METTS %d = %.14f",m.num,m.s2);
+    printfln("Average total susceptibility = %.14f %.3E",asus,esus);
+    printfln("Average total susceptibility per site = %.14f %.3E (%.5f,%.5f)",
+             asus/N,esus/N,(asus-esus)/N,(asus+esus)/N);
+
+    stats.sxy2.putin(m.sxy2);
+    asus = (stats.sxy2.avg()*beta/2);
+    esus = (stats.sxy2.err()*beta/2);
+    printfln("<(Sx^2+Sy^2)> for METTS %d = %.14f",m.num,m.sxy2);
+    printfln("Average total XY susceptibility = %.14f %.3E",asus,esus);
+    printfln("Average total XY susceptibility per site = %.14f %.3E (%.5f,%.5f)",
+             asus/N,esus/N,(asus-esus)/N,(asus+esus)/N);
+    }
+
+void inline
+writeStats(std::ostream& s,
+           Real beta,
+           int N,
+           int nmetts,
+           METTSStats const& stats)
+    {
+    auto avgEn = stats.en.avg();
+    auto C = (stats.en2.avg()-sqr(avgEn))*sqr(beta);
+    s << format("%.10f %.14f %.3E %.14f %.3E %.14f %.3E %.14f %.3E %d\n",
+                beta,
+                avgEn/N,stats.en.err()/N,
+                C/N,stats.en2.err()/N,
+                stats.s2.avg()*beta/3/N,stats.s2.err()*beta/3/N,
+                stats.sxy2.avg()*beta/2/N,stats.sxy2.err()*beta/2/N,
+                nmetts);
+    s.flush();
+    }
+
+} //namespace itensor
+
+#endif //__METTS_H
@@ -1,6 +1,17 @@
 #include "itensor/all.h"
 #include "TStateObserver.h"
 #include "S2.h"
+#include "disentangle.h"
+#include "snapshot.h"
+#include "inputlist.h"
+#include "artifact_cache.h"
+#include "mempool.h"
+#include "mpo_tevol.h"
+#include "doubling.h"
+#include "memgovernor.h"
+#include "correlations.h"
+#include "local_energy.h"
+#include "expect.h"
 
 using namespace std;
 using namespace itensor;
@@ -37,7 +48,25 @@ main(int argc, char* argv[])
     auto Jxy = input.getReal("Jxy",1.);
 
     auto realstep = input.getYesNo("realstep",false);
+    auto disentangle = input.getYesNo("disentangle",false);
+    auto snapshot_betas = parseRealList(input.getString("snapshot_betas",""));
     auto verbose = input.getYesNo("verbose",false);
+    auto cache_dir = input.getString("cache_dir","");
+    auto mempool = input.getYesNo("mempool",false);
+    auto pool_top_pad = input.getReal("pool_top_pad",64);
+    auto pool_max = input.getReal("pool_max",4096);
+    auto doubling = input.getYesNo("doubling",false);
+    auto beta0 = input.getReal("beta0",0.25);
+    auto memory_budget = input.getReal("memory_budget",0.);
+    auto tmax = input.getReal("tmax",0.);
+    auto dt = input.getReal("dt",0.1);
+    auto corr_op = input.getString("corr_op","Sz");
+    auto corr_site = input.getInt("corr_site",0);
+    auto back_evolve = input.getYesNo("back_evolve",true);
+    auto measure_betas = parseRealList(input.getString("measure_betas",""));
+    auto measure_every = input.getInt("measure_every",1);
+    auto energy_method = input.getString("energy_method","mpo");
+    auto measure_threads = input.getInt("measure_threads",1);
 
     auto N = Nx*Ny;
 
@@ -49,8 +78,14 @@ main(int argc, char* argv[])
     args.add("Cutoff",cutoff);
     args.add("YPeriodic",periodic);
     args.add("Verbose",verbose);
-
-    auto sites = SpinHalf(2*N);
+    args.add("MemoryPool",mempool);
+    args.add("PoolTopPad",pool_top_pad);
+    args.add("PoolMaxMB",pool_max);
+
+    //Operators built at startup may be taken from the artifact cache,
+    //which then also provides the site set
+    auto cache = ArtifactCache(cache_dir);
+    auto sites = cache.sites<SpinHalf>(format("SpinHalf N=%d",2*N),[N]() { return SpinHalf(2*N); });
     writeToFile("sites",sites);
 
     LatticeGraph lattice; 
@@ -59,6 +94,73 @@ main(int argc, char* argv[])
     else if(lattice_type == "square")
         lattice = squareLattice(Nx,Ny,args);
 
+    args.add("RealStep",realstep);
+
+    //
+    // Free energy and entropy per site from log Z(beta):
+    //   F = -log(Z)/beta, S = beta (E - F)
+    //
+    auto thermoLine = [N](Real bb, Real en_per_site, Real lnZ)
+        {
+        auto f = -lnZ/bb/N;
+        return format("%.14f %.14f %.14f %.14f\n",bb,en_per_site,f,bb*(en_per_site-f));
+        };
+    auto thermo_header = "# beta E/N F/N S/N\n";
+
+    if(doubling)
+        {
+        //The doubling mode has no purified state, and measures
+        //at the doubling grid only
+        auto unsupported = std::vector<std::string>();
+        if(tmax > 0) unsupported.push_back("tmax");
+        if(!snapshot_betas.empty()) unsupported.push_back("snapshot_betas");
+        if(disentangle) unsupported.push_back("disentangle");
+        if(!measure_betas.empty()) unsupported.push_back("measure_betas");
+        if(measure_every != 1) unsupported.push_back("measure_every");
+        if(energy_method != "mpo") unsupported.push_back("energy_method");
+        if(memory_budget > 0) unsupported.push_back("memory_budget");
+        if(!unsupported.empty())
+            {
+            auto names = std::string();
+            for(auto& u : unsupported) names += " "+u;
+            Error("doubling=yes cannot be combined with:"+names);
+            }
+
+        //
+        // Beta doubling of the density operator of the
+        // physical sites, an MPO on N sites
+        //
+        auto psites = cache.sites<SpinHalf>(format("SpinHalf N=%d",N),[N]() { return SpinHalf(N); });
+        auto pampo = AutoMPO(psites);
+        for(auto b : lattice)
+            {
+            pampo += (0.5*Jxy),"S+",b.s1,"S-",b.s2;
+            pampo += (0.5*Jxy),"S-",b.s1,"S+",b.s2;
+            pampo +=        Jz,"Sz",b.s1,"Sz",b.s2;
+            }
+        auto pdesc = format("%s Nx=%d Ny=%d YPeriodic=%d Jxy=%.17g Jz=%.17g",
+                            lattice_type,Nx,Ny,int(periodic),Jxy,Jz);
+        auto pexpH = makeExpH<TensorT>(pampo,tau,cache,pdesc,args);
+        auto pH = cache.mpo<MPOT>("H "+pdesc,psites,[&pampo]() { return MPOT(pampo); });
+        auto pS2 = cache.mpo<MPOT>(format("S2 N=%d",N),psites,[&psites]() { return makeS2(psites); });
+
+        auto points = betaDoubling(pexpH,tau,pH,pS2,beta0,beta,args);
+
+        std::ofstream enf("en.dat");
+        std::ofstream susf("sus.dat");
+        std::ofstream mf("bonddim.dat");
+        std::ofstream thf("thermo.dat");
+        thf << thermo_header;
+        for(auto& p : points)
+            {
+            enf << format("%.14f %.14f\n",p.beta,p.en);
+            susf << format("%.14f %.14f\n",p.beta,p.sus);
+            mf << format("%.14f %d %.4f\n",p.beta,p.maxm,p.cpu);
+            thf << thermoLine(p.beta,p.en,p.lnZ);
+            }
+        return 0;
+        }
+
     auto ampo = AutoMPO(sites);
     for(auto b : lattice)
         {
@@ -69,25 +171,15 @@ main(int argc, char* argv[])
         ampo +=        Jz,"Sz",s1,"Sz",s2;
         }
 
-    MPOT expHa,expHb;
-    MPOT expH;
+    auto hdesc = format("ancilla %s Nx=%d Ny=%d YPeriodic=%d Jxy=%.17g Jz=%.17g",
+                        lattice_type,Nx,Ny,int(periodic),Jxy,Jz);
 
-    if(realstep)
-        {
-        expH = toExpH<TensorT>(ampo,tau);
-        }
-    else
-        {
-        auto taua = tau/2.*(1.+1._i);
-        auto taub = tau/2.*(1.-1._i);
-        println("Making expHa and expHb");
-        expHa = toExpH<TensorT>(ampo,taua);
-        expHb = toExpH<TensorT>(ampo,taub);
-        }
+    auto expH = makeExpH<TensorT>(ampo,tau,cache,hdesc,args);
 
-    auto H = MPOT(ampo);
+    auto H = cache.mpo<MPOT>("H "+hdesc,sites,[&ampo]() { return MPOT(ampo); });
 
-    auto S2 = makeS2(sites,{"SkipAncilla=",true});
+    auto S2 = cache.mpo<MPOT>(format("S2 SkipAncilla=1 N=%d",2*N),sites,
+                              [&sites]() { return makeS2(sites,{"SkipAncilla=",true}); });
 
     //
     // Make initial 'wavefunction' which is a product
@@ -120,62 +212,237 @@ main(int argc, char* argv[])
 
     auto targs = args;
 
-    auto En = Vector(nt);
-    auto Sus = Vector(nt);
-    auto Betas = Vector(nt);
+    auto En = std::vector<Real>();
+    auto Sus = std::vector<Real>();
+    auto Betas = std::vector<Real>();
+    auto Maxms = std::vector<long>();
+    auto CPUs = std::vector<Real>();
 
-    Real tsofar = 0;
-    for(int tt = 1; tt <= nt; ++tt)
+    //Measure at the betas in measure_betas if given, else every
+    //measure_every steps, and always after the last step
+    auto isMeasured = [&](int tt, Real bb)
         {
-        if(realstep)
+        if(tt == nt) return true;
+        if(!measure_betas.empty())
             {
-            psi = exactApplyMPO(expH,psi,args);
+            for(auto mb : measure_betas) if(fabs(mb-bb) < 1E-8) return true;
+            return false;
             }
-        else
+        return measure_every > 0 && tt%measure_every == 0;
+        };
+
+    if(energy_method != "mpo" && energy_method != "local")
+        {
+        Error("energy_method must be mpo or local");
+        }
+    auto bonds = std::vector<BondTerm>();
+    for(auto b : lattice)
+        {
+        auto bt = BondTerm();
+        bt.s1 = 2*b.s1-1;
+        bt.s2 = 2*b.s2-1;
+        bt.Jz = Jz;
+        bt.Jxy = Jxy;
+        bonds.push_back(bt);
+        }
+
+    auto cpu_start = cpu_mytime();
+    auto memory = MemoryTracker();
+    MemoryPool pool(args);
+
+    auto gargs = args;
+    gargs.add("MPOLinkDim",maxLinkDim(expH));
+    gargs.add("Complex",!realstep);
+    auto governor = MemoryGovernor(memory_budget,gargs);
+    governor.limit(psi,args);
+
+    //
+    // The initial state is normalized and <psi|psi> = Tr(exp(-beta H))/2^N,
+    // so log Z(beta) = N log 2 + the sum of 2 log(norm) over the steps,
+    // where norm is that of psi after a step from a normalized state.
+    // The norm is taken once per step, after both complex factors of
+    // the two-step scheme: since tau_a + tau_b = tau their product is
+    // the real step exp(-tau H), while the state between the two is
+    // complex and its norm is not a ratio of partition functions.
+    //
+    Real lnZ = N*std::log(2.);
+
+    std::ofstream thf("thermo.dat");
+    thf << thermo_header;
+
+    Real tsofar = 0;
+    for(int tt = 1; tt <= nt; ++tt)
+        {
+        applyExpH(expH,psi,args);
+        if(governor.capped()) governor.reportKept(psi);
+        if(disentangle)
             {
-            psi = exactApplyMPO(expHa,psi,args);
-            psi = exactApplyMPO(expHb,psi,args);
+            auto dS = disentangleAncilla(psi,args);
+            printfln("Ancilla disentangler reduced Renyi entropies by %.6f",dS);
+            psi.position(1);
             }
-        psi.Aref(1) /= norm(psi.A(1));
+        auto nrm = norm(psi.A(1));
+        lnZ += 2*std::log(nrm);
+        psi.Aref(1) /= nrm;
         tsofar += tau;
         targs.add("TimeStepNum",tt);
         targs.add("Time",tsofar);
         targs.add("TotalTime",ttotal);
         obs.measure(targs);
 
-        //Record beta value
         auto bb = (2*tsofar);
-        Betas(tt-1) = bb;
+
+        for(auto sb : snapshot_betas)
+            {
+            if(fabs(sb-bb) > 1E-8) continue;
+            auto fname = format("ancilla_b%.4f.snp",bb);
+            printfln("Writing snapshot %s",fname);
+            writeSnapshot(fname,psi,{"Beta",bb,"Step",tt});
+            }
+
+        memory.sample();
+
+        if(!isMeasured(tt,bb))
+            {
+            println();
+            continue;
+            }
+
+        //Record beta value
+        Betas.push_back(bb);
+
+        //Record bond dimension and time taken so far
+        long maxm_tt = 0;
+        for(int b = 1; b < psi.N(); ++b)
+            {
+            maxm_tt = std::max(maxm_tt,linkInd(psi,b).m());
+            }
+        Maxms.push_back(maxm_tt);
+        CPUs.push_back(cpu_mytime()-cpu_start);
 
         //
-        // Measure Energy
+        // Measure Energy and Susceptibility, with the MPOs
+        // contracted concurrently on measure_threads threads
         //
-        auto en = overlap(psi,H,psi);
+        auto mpos = std::vector<MPOT const*>{&S2};
+        if(energy_method == "mpo") mpos.push_back(&H);
+        auto vals = expectMPOs(psi,mpos,{"Threads",measure_threads});
+
+        auto en = (energy_method == "local" ? localEnergy(psi,bonds) : vals.at(1));
         printfln("\nEnergy/N %.4f %.20f",bb,en/N);
-        En(tt-1) = en/N;
+        En.push_back(en/N);
+
+        auto s2val = vals.at(0);
+        Sus.push_back((s2val*bb/3.)/N);
 
         //
-        // Measure Susceptibility
+        // Free energy and entropy
         //
-        auto s2val = overlap(psi,S2,psi);
-        Sus(tt-1) = (s2val*bb/3.)/N;
+        printfln("Free energy/N %.4f %.20f",bb,-lnZ/bb/N);
+        thf << thermoLine(bb,en/N,lnZ);
+        thf.flush();
 
         println();
         }
 
+    pool.end();
+    memory.report("Ancilla evolution");
+
     std::ofstream enf("en.dat");
     std::ofstream susf("sus.dat");
+    std::ofstream mf("bonddim.dat");
     for(auto n : range(Betas))
         {
-        enf << format("%.14f %.14f\n",Betas(n),En(n));
-        susf << format("%.14f %.14f\n",Betas(n),Sus(n));
+        enf << format("%.14f %.14f\n",Betas.at(n),En.at(n));
+        susf << format("%.14f %.14f\n",Betas.at(n),Sus.at(n));
+        mf << format("%.14f %d %.4f\n",Betas.at(n),Maxms.at(n),CPUs.at(n));
         }
     enf.close();
     susf.close();
+    mf.close();
+    thf.close();
 
     writeToFile("sites",sites);
     writeToFile("psi",psi);
 
+    if(tmax > 0)
+        {
+        //
+        // Real time correlations <S_i(t) S_j(0)> at inverse temperature beta,
+        // with S = corr_op and j = corr_site (physical sites)
+        //
+        // The purified state satisfies (H_P - H_A)|psi> = 0, where H_P acts on
+        // the physical sites and H_A is the same Hamiltonian on the ancillas:
+        // the singlets map every spin operator of a physical site to minus that
+        // of its ancilla, which leaves the Heisenberg bonds unchanged, and H_A
+        // commutes with exp(-beta H_P/2). Therefore
+        //   <S_i(t) S_j(0)> = <psi| S_i exp(-i(H_P-H_A)t) S_j |psi>
+        // and evolving the ancillas backward in time slows down the growth
+        // of entanglement without changing the result.
+        //
+        auto j0 = (corr_site > 0 ? corr_site : std::max(1,N/2));
+        auto use_anc = back_evolve;
+        if(use_anc && disentangle)
+            {
+            println("Ancillas were disentangled, evolving the physical sites only");
+            use_anc = false;
+            }
+
+        auto rtampo = AutoMPO(sites);
+        for(auto b : lattice)
+            {
+            auto s1 = 2*b.s1-1,
+                 s2 = 2*b.s2-1;
+            rtampo += (0.5*Jxy),"S+",s1,"S-",s2;
+            rtampo += (0.5*Jxy),"S-",s1,"S+",s2;
+            rtampo +=        Jz,"Sz",s1,"Sz",s2;
+            if(use_anc)
+                {
+                rtampo += (-0.5*Jxy),"S+",s1+1,"S-",s2+1;
+                rtampo += (-0.5*Jxy),"S-",s1+1,"S+",s2+1;
+                rtampo +=        -Jz,"Sz",s1+1,"Sz",s2+1;
+                }
+            }
+        auto rtdesc = format("%s back_evolve=%d",hdesc,int(use_anc));
+        auto expHrt = makeRealTimeExpH<TensorT>(rtampo,dt,cache,rtdesc,args);
+
+        auto phys = std::vector<int>();
+        for(int i = 1; i <= N; ++i) phys.push_back(2*i-1);
+
+        psi.position(1);
+        psi.Aref(1) /= norm(psi.A(1));
+
+        auto phi = psi;
+        auto s0 = 2*j0-1;
+        phi.position(s0);
+        phi.Aref(s0) = noprime(phi.A(s0)*sites.op(corr_op,s0),Site);
+
+        std::ofstream cf("corr_t.dat");
+        cf << format("# beta = %.10f, <%s_i(t) %s_j(0)> for j = %d: t i Re Im\n",beta,corr_op,corr_op,j0);
+        auto writeCorr = [&](Real t)
+            {
+            auto C = matrixElements(psi,phi,corr_op,phys);
+            for(int i = 1; i <= N; ++i)
+                {
+                cf << format("%.10f %d %.14f %.14f\n",t,i,C.at(i-1).real(),C.at(i-1).imag());
+                }
+            cf.flush();
+            };
+
+        const int nrt = int(tmax/dt+1E-9);
+        printfln("\nDoing %d real time steps of dt=%f",nrt,dt);
+        writeCorr(0.);
+        for(int tt = 1; tt <= nrt; ++tt)
+            {
+            applyExpH(expHrt,phi,args);
+            if(governor.capped()) governor.reportKept(phi);
+            long maxm_phi = 0;
+            for(int b = 1; b < phi.N(); ++b) maxm_phi = std::max(maxm_phi,linkInd(phi,b).m());
+            printfln("t = %.4f, maxm = %d",tt*dt,maxm_phi);
+            writeCorr(tt*dt);
+            }
+        }
+
     return 0;
     }
 
@@ -0,0 +1,219 @@
+#ifndef __MPO_TEVOL_H
+#define __MPO_TEVOL_H
+
+#include "itensor/all.h"
+#include "artifact_cache.h"
+
+namespace itensor {
+
+//
+// Imaginary time evolution by exp(-tau H) in MPO form.
+//
+// exp(-tau H) is made by toExpH either as one MPO, with an error of
+// order tau^2 per step, or (the default) as the product of two MPOs
+// with the complex time steps tau_a = tau/2 (1+i), tau_b = tau/2 (1-i),
+// whose error is of order tau^3 per step.
+//
+// The MPOs are applied with exactApplyMPO, which builds the new bond
+// dimension from the exact product of MPO and MPS. Unlike a variational
+// fit it needs no initial guess, so it works from a product state (m=1).
+//
+// Recognized args of makeExpH:
+//   "RealStep" (default false): use a single real time step
+//
+template<class Tensor>
+using ExpH = std::vector<MPOt<Tensor>>;
+
+//
+// Make the factors of exp(-tau H), taking them from
+// the artifact cache if available. The description desc
+// of H is used to build the cache keys.
+//
+template<class Tensor>
+ExpH<Tensor>
+makeExpH(AutoMPO const& ampo,
+         Real tau,
+         ArtifactCache& cache,
+         std::string const& desc,
+         Args const& args = Global::args());
+
+template<class Tensor>
+ExpH<Tensor>
+makeExpH(AutoMPO const& ampo,
+         Real tau,
+         Args const& args = Global::args());
+
+//
+// Factors of the real time evolution operator exp(-i dt H),
+// made the same way as exp(-tau H) with tau = i dt
+//
+template<class Tensor>
+ExpH<Tensor>
+makeRealTimeExpH(AutoMPO const& ampo,
+                 Real dt,
+                 ArtifactCache& cache,
+                 std::string const& desc,
+                 Args const& args = Global::args());
+
+//
+// One time step psi -> exp(-tau H) psi, unnormalized
+//
+template<class Tensor>
+void
+applyExpH(ExpH<Tensor> const& expH,
+          MPSt<Tensor>& psi,
+          Args const& args = Global::args());
+
+//
+// Largest bond dimension of the factors of exp(-tau H)
+//
+template<class Tensor>
+long
+maxLinkDim(ExpH<Tensor> const& expH);
+
+//
+// Evolve psi by ttotal in steps of tstep (the tau
+// expH was made with), normalizing psi after each step
+//
+template<class Tensor>
+void
+mpoTEvol(ExpH<Tensor> const& expH,
+         Real ttotal,
+         Real tstep,
+         MPSt<Tensor>& psi,
+         Observer& obs,
+         Args args = Global::args());
+
+
+//
+// Implementations
+//
+
+//
+// Factors of exp(-tau H) for complex tau, cached under
+// the keys "expH <label>", "expHa <label>", "expHb <label>"
+//
+template<class Tensor>
+ExpH<Tensor>
+makeExpHFactors(AutoMPO const& ampo,
+                Cplx tau,
+                ArtifactCache& cache,
+                std::string const& label,
+                Args const& args)
+    {
+    using MPOT = MPOt<Tensor>;
+    auto const& sites = ampo.sites();
+
+    auto expH = ExpH<Tensor>();
+    if(args.getBool("RealStep",false))
+        {
+        expH.push_back(cache.mpo<MPOT>("expH "+label,sites,
+                                       [&]() { return toExpH<Tensor>(ampo,tau); }));
+        }
+    else
+        {
+        auto taua = tau/2.*(1.+1._i);
+        auto taub = tau/2.*(1.-1._i);
+        println("Making expHa and expHb");
+        expH.push_back(cache.mpo<MPOT>("expHa "+label,sites,
+                                       [&]() { return toExpH<Tensor>(ampo,taua); }));
+        expH.push_back(cache.mpo<MPOT>("expHb "+label,sites,
+                                       [&]() { return toExpH<Tensor>(ampo,taub); }));
+        }
+    return expH;
+    }
+
+template<class Tensor>
+ExpH<Tensor>
+makeExpH(AutoMPO const& ampo,
+         Real tau,
+         ArtifactCache& cache,
+         std::string const& desc,
+         Args const& args)
+    {
+    return makeExpHFactors<Tensor>(ampo,Cplx(tau,0.),cache,format("tau=%.17g %s",tau,desc),args);
+    }
+
+template<class Tensor>
+ExpH<Tensor>
+makeRealTimeExpH(AutoMPO const& ampo,
+                 Real dt,
+                 ArtifactCache& cache,
+                 std::string const& desc,
+                 Args const& args)
+    {
+    return makeExpHFactors<Tensor>(ampo,Cplx(0.,dt),cache,format("realtime dt=%.17g %s",dt,desc),args);
+    }
+
+template<class Tensor>
+ExpH<Tensor>
+makeExpH(AutoMPO const& ampo,
+         Real tau,
+         Args const& args)
+    {
+    auto nocache = ArtifactCache();
+    return makeExpH<Tensor>(ampo,tau,nocache,"",args);
+    }
+
+template<class Tensor>
+void
+applyExpH(ExpH<Tensor> const& expH,
+          MPSt<Tensor>& psi,
+          Args const& args)
+    {
+    for(auto& K : expH)
+        {
+        psi = exactApplyMPO(K,psi,args);
+        }
+    }
+
+template<class Tensor>
+long
+maxLinkDim(ExpH<Tensor> const& expH)
+    {
+    long k = 1;
+    for(auto& K : expH)
+    for(int b = 1; b < K.N(); ++b)
+        {
+        k = std::max(k,commonIndex(K.A(b),K.A(b+1),Link).m());
+        }
+    return k;
+    }
+
+template<class Tensor>
+void
+mpoTEvol(ExpH<Tensor> const& expH,
+         Real ttotal,
+         Real tstep,
+         MPSt<Tensor>& psi,
+         Observer& obs,
+         Args args)
+    {
+    const bool verbose = args.getBool("Verbose",false);
+
+    const int nt = int(ttotal/tstep+(1e-9*(ttotal/tstep)));
+    if(fabs(nt*tstep-ttotal) > 1E-9)
+        {
+        Error("Timestep not commensurate with total time");
+        }
+
+    Real tsofar = 0;
+    for(int tt = 1; tt <= nt; ++tt)
+        {
+        applyExpH(expH,psi,args);
+        psi.position(1);
+        psi.Aref(1) /= norm(psi.A(1));
+
+        tsofar += tstep;
+        args.add("TimeStepNum",tt);
+        args.add("Time",tsofar);
+        args.add("TotalTime",ttotal);
+        obs.measure(args);
+        }
+
+    if(verbose) printfln("\nTotal time evolved = %.5f\n",tsofar);
+    }
+
+} //namespace itensor
+
+#endif //__MPO_TEVOL_H
@@ -0,0 +1,233 @@
+#ifndef __PARALLEL_TEVOL_H
+#define __PARALLEL_TEVOL_H
+
+#include <algorithm>
+#include <vector>
+#include "itensor/mps/mps.h"
+#include "itensor/mps/observer.h"
+#include "trotter.h"
+#include "gate_kernel.h"
+#include "rsvd.h"
+#include "threadpool.h"
+
+namespace itensor {
+
+//
+// Real-space parallel version of gateTEvol.
+//
+// The chain is split into "Segments" segments of consecutive sites.
+// Gate groups (see makeGateGroups) acting only within one segment are
+// applied concurrently, one thread per segment, on a thread pool kept
+// for the whole evolution; groups crossing a segment boundary are
+// applied afterwards on a single thread. Each
+// time step applies the groups in the order
+//   [interior in parallel] [boundary] [boundary reversed] [interior reversed in parallel]
+// which keeps the Trotter decomposition symmetric and second order.
+//
+// During the evolution the MPS is kept in the form
+//   psi = B_1 B_2 ... B_N,  B_n = Gamma_n Lambda_n
+// with the B_n right-orthogonal and the singular values Lambda_n of
+// every bond stored. A gate on sites n,n+1 then only needs Lambda_{n-1},
+// B_n and B_{n+1}, and the new B_n is computed without inverting any
+// singular values (Hastings, J. Math. Phys. 50, 095207 (2009)).
+//
+// The product B_1 ... B_N is psi after each gate up to the truncation,
+// but the new B_n is right-orthogonal only for unitary gates. For the
+// imaginary time gates exp(-tau h) the B_n and Lambda_n drift away from
+// the canonical form by O(tau) per gate, so the truncations within a
+// step use approximate singular values. After every time step psi is
+// brought back into exact canonical form by an SVD sweep, which also
+// gives new B_n and Lambda_n for the next step; on return psi is
+// normalized and really centered at site 1.
+//
+// The weight discarded in each step is passed to the observer as
+// "TruncErr".
+//
+// The SVD of each gate makes a new bond index, and the index id
+// generator of ITensor is not thread safe. The SVDs are done by
+// svdTruncated (see rsvd.h), which makes the new indices under
+// indexMutex() but runs the dense SVDs of the QN blocks outside of
+// it, so the SVDs, the gate application and the other contractions
+// of the segments all run concurrently.
+//
+template<class Tensor>
+void
+parallelGateTEvol(std::vector<GateGroup<Tensor>> const& groups,
+                  Real ttotal,
+                  Real tstep,
+                  MPSt<Tensor>& psi,
+                  Observer& obs,
+                  Args args = Global::args());
+
+
+//
+// Implementations
+//
+
+template<class Tensor>
+Real
+applyHastingsGate(BondGate<Tensor> const& G,
+                  std::vector<Tensor>& B,
+                  std::vector<Tensor>& Lam,
+                  SiteSet const& sites,
+                  Args const& args)
+    {
+    auto n = G.i1();
+
+    auto AA = B.at(n)*B.at(n+1);
+    applyGate(G,AA,sites);
+
+    Tensor U,S,V;
+    auto theta = (n > 1 ? Lam.at(n-1)*AA : AA);
+    U = (n > 1 ? Tensor(uniqueIndex(Lam.at(n-1),B.at(n),Link),sites.si(n)) : Tensor(sites.si(n)));
+    auto truncerr = svdTruncated(theta,U,S,V,args);
+
+    auto nrm = norm(S);
+    S /= nrm;
+    B.at(n) = AA*dag(V);
+    B.at(n) /= nrm;
+    B.at(n+1) = V;
+    Lam.at(n) = S;
+    return truncerr;
+    }
+
+template<class Tensor>
+Real
+applyGroups(std::vector<GateGroup<Tensor> const*> const& groups,
+            bool reverse,
+            std::vector<Tensor>& B,
+            std::vector<Tensor>& Lam,
+            SiteSet const& sites,
+            Args const& args)
+    {
+    Real truncerr = 0;
+    if(!reverse)
+        {
+        for(auto g : groups)
+        for(auto& G : g->gates)
+            {
+            truncerr += applyHastingsGate(G,B,Lam,sites,args);
+            }
+        }
+    else
+        {
+        for(auto g = groups.rbegin(); g != groups.rend(); ++g)
+        for(auto G = (*g)->gates.rbegin(); G != (*g)->gates.rend(); ++G)
+            {
+            truncerr += applyHastingsGate(*G,B,Lam,sites,args);
+            }
+        }
+    return truncerr;
+    }
+
+template<class Tensor>
+void
+parallelGateTEvol(std::vector<GateGroup<Tensor>> const& groups,
+                  Real ttotal,
+                  Real tstep,
+                  MPSt<Tensor>& psi,
+                  Observer& obs,
+                  Args args)
+    {
+    using GroupPtrs = std::vector<GateGroup<Tensor> const*>;
+
+    const bool verbose = args.getBool("Verbose",false);
+    const int nseg = args.getInt("Segments",1);
+
+    const int nt = int(ttotal/tstep+(1e-9*(ttotal/tstep)));
+    if(fabs(nt*tstep-ttotal) > 1E-9)
+        {
+        Error("Timestep not commensurate with total time");
+        }
+
+    auto const& sites = psi.sites();
+    auto N = psi.N();
+
+    //
+    // Sort the gate groups into segments
+    //
+    auto segment = [N,nseg](int j) { return ((j-1)*nseg)/N; };
+    auto interior = std::vector<GroupPtrs>(nseg);
+    auto boundary = GroupPtrs();
+    for(auto& g : groups)
+        {
+        if(segment(g.first) == segment(g.last)) interior.at(segment(g.first)).push_back(&g);
+        else                                    boundary.push_back(&g);
+        }
+    if(verbose)
+        {
+        printfln("Parallel TEBD with %d segments, %d boundary groups",nseg,boundary.size());
+        }
+
+    //
+    // Bring psi into canonical form centered at site 1, with the
+    // B_n right-orthogonal and the singular values of every bond
+    //
+    auto B = std::vector<Tensor>(N+1);
+    auto Lam = std::vector<Tensor>(N);
+    auto canonicalize = [&psi,&B,&Lam,N]()
+        {
+        psi.position(N);
+        auto C = psi.A(N);
+        for(int n = N; n > 1; --n)
+            {
+            Tensor U(commonIndex(psi.A(n-1),C,Link)),S,V;
+            svd(C,U,S,V,{"Cutoff",1E-16});
+            B.at(n) = V;
+            Lam.at(n-1) = S;
+            C = psi.A(n-1)*U*S;
+            }
+        B.at(1) = C/norm(C);
+        for(int n = 1; n <= N; ++n)
+            {
+            psi.Aref(n) = B.at(n);
+            }
+        psi.leftLim(0);
+        psi.rightLim(2);
+        };
+    canonicalize();
+
+    ThreadPool pool(nseg > 1 ? nseg : 0);
+    auto segerr = std::vector<Real>(nseg,0.);
+    auto applyInterior = [&](bool reverse)
+        {
+        pool.run(nseg,[&interior,reverse,&B,&Lam,&sites,&args,&segerr](int s)
+            {
+            segerr.at(s) += applyGroups(interior.at(s),reverse,B,Lam,sites,args);
+            });
+        };
+
+    Real tsofar = 0;
+    for(int tt = 1; tt <= nt; ++tt)
+        {
+        std::fill(segerr.begin(),segerr.end(),0.);
+        applyInterior(false);
+        auto truncerr = applyGroups(boundary,false,B,Lam,sites,args);
+        truncerr += applyGroups(boundary,true,B,Lam,sites,args);
+        applyInterior(true);
+        for(auto e : segerr) truncerr += e;
+
+        //The gates were not unitary, so psi is not
+        //in canonical form anymore
+        for(int n = 1; n <= N; ++n)
+            {
+            psi.Aref(n) = B.at(n);
+            }
+        psi.leftLim(0);
+        psi.rightLim(N+1);
+        canonicalize();
+
+        tsofar += tstep;
+        args.add("TruncErr",truncerr);
+        args.add("TimeStepNum",tt);
+        args.add("Time",tsofar);
+        args.add("TotalTime",ttotal);
+        obs.measure(args);
+        }
+
+    if(verbose) printfln("\nTotal time evolved = %.5f\n",tsofar);
+    }
+
+} //namespace itensor
+
+#endif //__PARALLEL_TEVOL_H
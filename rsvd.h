@@ -0,0 +1,282 @@
+#ifndef __RSVD_H
+#define __RSVD_H
+
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include "itensor/all.h"
+#include "threadpool.h"
+#include "blocksvd.h"
+
+namespace itensor {
+
+//
+// Truncated SVD with a selectable method.
+//
+// svdTruncated(AA,U,S,V,args) has the same meaning as svd(AA,U,S,V,args):
+// the indices of U on entry are the row indices of AA, and on return
+// AA ~ U*S*V, truncated according to "Maxm", "Minm" and "Cutoff". It
+// returns the truncation error, the discarded weight relative to
+// norm(AA)^2.
+//
+// Recognized args:
+//   "SVDMethod" "full" (default): ITensor's svd
+//               "rsvd": randomized range finder (Halko, Martinsson and
+//               Tropp, SIAM Rev. 53, 217 (2011)). The row space of AA
+//               is sketched by AA*Omega with a random Omega of Maxm
+//               plus "RSVDOversample" columns, refined by "RSVDPower"
+//               power iterations, and the SVD is done in that subspace.
+//               For IQTensors the columns of Omega are distributed over
+//               the QN sectors in proportion to their size.
+//   "RSVDOversample" (default 10)
+//   "RSVDPower"      (default 1)
+//
+// The discarded weight of the randomized SVD is computed exactly, as
+// norm(AA)^2 minus the kept weight, so "Cutoff" keeps its meaning. If
+// the subspace found holds too little weight to reach the cutoff within
+// Maxm states, or if Maxm plus the oversampling is not smaller than the
+// matrix dimension, the full SVD is used instead. rsvdStats() counts
+// how often each branch was taken.
+//
+// svdTruncated may be called from several threads at once: the SVDs
+// are done by blockSVD (see blocksvd.h), which only holds indexMutex()
+// (see threadpool.h) while making new indices, and the randomized SVD
+// holds it only while making its combiners and drawing the random
+// sketch, since ITensor's random numbers are not thread safe either.
+// The dense SVDs and the contractions run concurrently. Callers must
+// not hold indexMutex() themselves.
+//
+template<class Tensor>
+Real
+svdTruncated(Tensor const& AA,
+             Tensor& U,
+             Tensor& S,
+             Tensor& V,
+             Args const& args = Global::args());
+
+//
+// Number of calls of the randomized SVD which used the randomized
+// range finder and which fell back to the full SVD
+//
+struct RSVDStats
+    {
+    long randomized = 0,
+         full = 0;
+    };
+
+RSVDStats
+rsvdStats();
+
+//
+// Same as psi.svdBond(b,AA,dir,args), using svdTruncated
+//
+template<class Tensor>
+Real
+svdBondTruncated(MPSt<Tensor>& psi,
+                 int b,
+                 Tensor const& AA,
+                 Direction dir,
+                 Args const& args = Global::args());
+
+
+//
+// Implementations
+//
+
+inline std::atomic<long>&
+rsvdCount(bool randomized)
+    {
+    static std::atomic<long> counts[2] = {{0},{0}};
+    return counts[randomized ? 1 : 0];
+    }
+
+inline RSVDStats
+rsvdStats()
+    {
+    auto st = RSVDStats();
+    st.randomized = rsvdCount(true);
+    st.full = rsvdCount(false);
+    return st;
+    }
+
+inline Index
+sketchIndex(Index const& c,
+            long k,
+            long p)
+    {
+    return Index("sketch",std::min(c.m(),k+p));
+    }
+
+inline IQIndex
+sketchIndex(IQIndex const& c,
+            long k,
+            long p)
+    {
+    auto D = Real(c.m());
+    auto sectors = IQIndex::storage();
+    for(auto& iq : c)
+        {
+        auto dq = iq.m();
+        auto n = std::min(dq,long(std::ceil(k*dq/D))+p);
+        sectors.emplace_back(Index("sketch",n),iq.qn);
+        }
+    return IQIndex("sketch",std::move(sectors),c.dir());
+    }
+
+inline ITensor
+sketchTensor(Index const& c,
+             Index const& r)
+    {
+    return randomTensor(c,r);
+    }
+
+inline IQTensor
+sketchTensor(IQIndex const& c,
+             IQIndex const& r)
+    {
+    return randomTensor(QN(),c,r);
+    }
+
+template<class Tensor>
+Real
+randomizedSVD(Tensor const& AA,
+              Tensor& U,
+              Tensor& S,
+              Tensor& V,
+              Args const& args)
+    {
+    using IndexT = typename Tensor::index_type;
+
+    auto fullSVD = [&]()
+        {
+        ++rsvdCount(false);
+        return blockSVD(AA,U,S,V,args);
+        };
+
+    auto maxm = args.getInt("Maxm",MAX_M);
+    auto minm = args.getInt("Minm",1);
+    auto cutoff = args.getReal("Cutoff",MIN_CUT);
+    auto p = args.getInt("RSVDOversample",10);
+    auto npower = args.getInt("RSVDPower",1);
+
+    //Combine the row and column indices
+    auto rows = std::vector<IndexT>();
+    auto cols = std::vector<IndexT>();
+    for(auto& i : AA.inds())
+        {
+        if(hasindex(U,i)) rows.push_back(i);
+        else              cols.push_back(i);
+        }
+    if(rows.empty() || cols.empty()) return fullSVD();
+    Tensor Cl,Cr;
+        {
+        std::lock_guard<std::mutex> lock(indexMutex());
+        Cl = combiner(rows);
+        Cr = combiner(cols);
+        }
+    auto M = AA*Cl*Cr;
+    auto cl = commonIndex(M,Cl);
+    auto cr = commonIndex(M,Cr);
+
+    //The sketch must be smaller than the matrix to save anything, and
+    //large enough to hold the Minm states to be kept
+    if(maxm+p >= std::min(cl.m(),cr.m()) || minm > maxm) return fullSVD();
+
+    //Orthonormal basis of the range of Y, whose rows are labeled by row
+    auto orth = [](Tensor const& Y, IndexT const& row)
+        {
+        Tensor Q(row),D,W;
+        blockSVD(Y,Q,D,W,{"Cutoff",1E-14});
+        return Q;
+        };
+
+    Tensor Omega;
+        {
+        std::lock_guard<std::mutex> lock(indexMutex());
+        Omega = sketchTensor(dag(cr),sketchIndex(cr,maxm,p));
+        }
+    auto Q = orth(M*Omega,cl);
+    for(int n = 0; n < npower; ++n)
+        {
+        auto Z = orth(dag(M)*Q,cr);
+        Q = orth(M*Z,cl);
+        }
+
+    //SVD in the subspace, with the cutoff adjusted for the
+    //weight of M outside of it so the total discarded weight
+    //relative to M is at most cutoff
+    auto B = dag(Q)*M;
+    auto total = sqr(norm(M));
+    auto inside = sqr(norm(B));
+    if(total == 0) return fullSVD();
+    auto bcutoff = (cutoff*total-(total-inside))/inside;
+    if(bcutoff < 0) return fullSVD();
+
+    auto Ub = Tensor(commonIndex(Q,B));
+    Tensor Vb;
+    blockSVD(B,Ub,S,Vb,{"Maxm",maxm,"Minm",minm,"Cutoff",bcutoff});
+    ++rsvdCount(true);
+
+    U = Q*Ub*dag(Cl);
+    V = Vb*dag(Cr);
+
+    return std::max(0.,total-sqr(norm(S)))/total;
+    }
+
+template<class Tensor>
+Real
+svdTruncated(Tensor const& AA,
+             Tensor& U,
+             Tensor& S,
+             Tensor& V,
+             Args const& args)
+    {
+    auto method = args.getString("SVDMethod","full");
+    if(method == "rsvd") return randomizedSVD(AA,U,S,V,args);
+    if(method != "full") Error("Unknown SVDMethod " + method);
+    return blockSVD(AA,U,S,V,args);
+    }
+
+template<class Tensor>
+Real
+svdBondTruncated(MPSt<Tensor>& psi,
+                 int b,
+                 Tensor const& AA,
+                 Direction dir,
+                 Args const& args)
+    {
+    if(args.getString("SVDMethod","full") == "full")
+        {
+        auto spec = psi.svdBond(b,AA,dir,args);
+        return spec.truncerr();
+        }
+
+    //Row indices: the site index of b and its link to b-1
+    auto U = (b == 1 ? Tensor(psi.sites()(b))
+                     : Tensor(commonIndex(psi.A(b-1),psi.A(b),Link),psi.sites()(b)));
+
+    Tensor S,V;
+    auto truncerr = svdTruncated(AA,U,S,V,args);
+
+    auto llim = psi.leftLim(),
+         rlim = psi.rightLim();
+    if(dir == Fromleft)
+        {
+        psi.Aref(b) = U;
+        psi.Aref(b+1) = S*V;
+        psi.leftLim(llim >= b-1 ? b : llim);
+        psi.rightLim(std::max(rlim,b+2));
+        }
+    else
+        {
+        psi.Aref(b) = U*S;
+        psi.Aref(b+1) = V;
+        psi.leftLim(std::min(llim,b-1));
+        psi.rightLim(rlim <= b+2 ? b+1 : rlim);
+        }
+    return truncerr;
+    }
+
+} //namespace itensor
+
+#endif //__RSVD_H
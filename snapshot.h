@@ -0,0 +1,334 @@
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <zlib.h>
+#include "itensor/mps/mps.h"
+
+namespace itensor {
+
+//
+// Compact, versioned snapshot files of MPS.
+//
+// Layout of a snapshot file:
+//   char[8]   magic "FTMPSSNP"
+//   uint32    version
+//   uint32    flags (1: blobs are zlib compressed, 2: file ends with an index)
+//   int32     N, left and right orthogonality limits of psi
+//   float64   beta
+//   int64     step (METTS number or time step)
+//   blob      site set
+//   blob      MPS tensor 1, ..., MPS tensor N
+//   [index]   uint64 offsets of the N+1 blobs, followed by the
+//             uint64 offset of the index itself
+// where every blob is
+//   uint64    uncompressed size
+//   uint64    stored size
+//   bytes     ITensor binary format of the object
+//
+// IQTensors are stored block-sparse with their QN blocks, as
+// in the ITensor binary format. The index allows reading single
+// site tensors without reading the rest of the file.
+//
+// Recognized args of writeSnapshot:
+//   "Beta"     (default 0)
+//   "Step"     (default 0)
+//   "Compress" (default true)
+//   "Index"    (default true)
+//
+
+struct SnapshotInfo
+    {
+    int version = 0;
+    int N = 0;
+    int llim = 0;
+    int rlim = 0;
+    Real beta = 0;
+    long step = 0;
+    bool compressed = false;
+    bool indexed = false;
+    };
+
+template<class Tensor>
+void
+writeSnapshot(std::string const& fname,
+              MPSt<Tensor> const& psi,
+              Args const& args = Global::args());
+
+//
+// Read the MPS stored in a snapshot. The site set, read with
+// readSnapshotSites, is passed in so that it can be shared by
+// many snapshots of the same run (and the MPOs measured on them).
+//
+template<class Tensor>
+MPSt<Tensor>
+readSnapshot(std::string const& fname,
+             SiteSet const& sites,
+             SnapshotInfo* info = nullptr);
+
+SnapshotInfo
+readSnapshotInfo(std::string const& fname);
+
+//
+// Read the site set of a snapshot, SiteSetT should be
+// the type of the site set it was written from, e.g. SpinHalf
+//
+template<class SiteSetT>
+SiteSetT
+readSnapshotSites(std::string const& fname);
+
+//
+// Read only the tensor of site n (1 <= n <= N)
+//
+template<class Tensor>
+Tensor
+readSnapshotSite(std::string const& fname,
+                 int n);
+
+
+//
+// Implementations
+//
+
+const char snapshot_magic[8] = {'F','T','M','P','S','S','N','P'};
+const uint32_t snapshot_version = 1;
+const uint32_t snapshot_compressed = 1;
+const uint32_t snapshot_indexed = 2;
+
+template<typename T>
+void
+snapWrite(std::ostream& s, T const& x)
+    {
+    s.write(reinterpret_cast<const char*>(&x),sizeof(T));
+    }
+
+template<typename T>
+T
+snapRead(std::istream& s)
+    {
+    T x;
+    s.read(reinterpret_cast<char*>(&x),sizeof(T));
+    return x;
+    }
+
+void inline
+writeSnapshotBlob(std::ostream& s,
+                  std::string const& raw,
+                  bool compress)
+    {
+    snapWrite<uint64_t>(s,raw.size());
+    if(!compress)
+        {
+        snapWrite<uint64_t>(s,raw.size());
+        s.write(raw.data(),raw.size());
+        return;
+        }
+    uLongf csize = compressBound(raw.size());
+    auto buf = std::string(csize,'\0');
+    auto res = compress2(reinterpret_cast<Bytef*>(&buf[0]),&csize,
+                         reinterpret_cast<const Bytef*>(raw.data()),raw.size(),
+                         Z_DEFAULT_COMPRESSION);
+    if(res != Z_OK) Error("Compression failed while writing snapshot");
+    snapWrite<uint64_t>(s,csize);
+    s.write(buf.data(),csize);
+    }
+
+std::string inline
+readSnapshotBlob(std::istream& s,
+                 bool compressed)
+    {
+    auto rawsize = snapRead<uint64_t>(s);
+    auto size = snapRead<uint64_t>(s);
+    auto buf = std::string(size,'\0');
+    s.read(&buf[0],size);
+    if(!s) Error("Snapshot file truncated");
+    if(!compressed) return buf;
+
+    auto raw = std::string(rawsize,'\0');
+    uLongf dsize = rawsize;
+    auto res = uncompress(reinterpret_cast<Bytef*>(&raw[0]),&dsize,
+                          reinterpret_cast<const Bytef*>(buf.data()),size);
+    if(res != Z_OK || dsize != rawsize) Error("Corrupt compressed data in snapshot");
+    return raw;
+    }
+
+SnapshotInfo inline
+readSnapshotHeader(std::istream& s)
+    {
+    char magic[8];
+    s.read(magic,8);
+    if(!s || !std::equal(magic,magic+8,snapshot_magic)) Error("Not a snapshot file");
+
+    auto info = SnapshotInfo();
+    info.version = snapRead<uint32_t>(s);
+    if(info.version > snapshot_version)
+        {
+        Error(format("Snapshot version %d is newer than supported version %d",info.version,snapshot_version));
+        }
+    auto flags = snapRead<uint32_t>(s);
+    info.compressed = (flags & snapshot_compressed);
+    info.indexed = (flags & snapshot_indexed);
+    info.N = snapRead<int32_t>(s);
+    info.llim = snapRead<int32_t>(s);
+    info.rlim = snapRead<int32_t>(s);
+    info.beta = snapRead<double>(s);
+    info.step = snapRead<int64_t>(s);
+    return info;
+    }
+
+//
+// Position the stream s at the start of blob number b,
+// where blob 0 is the site set and blob n the tensor of site n
+//
+void inline
+seekSnapshotBlob(std::istream& s,
+                 SnapshotInfo const& info,
+                 int b)
+    {
+    if(info.indexed)
+        {
+        s.seekg(-int(sizeof(uint64_t)),std::ios::end);
+        auto index_pos = snapRead<uint64_t>(s);
+        s.seekg(index_pos+b*sizeof(uint64_t));
+        auto pos = snapRead<uint64_t>(s);
+        s.seekg(pos);
+        return;
+        }
+    for(int j = 0; j < b; ++j)
+        {
+        snapRead<uint64_t>(s);
+        auto size = snapRead<uint64_t>(s);
+        s.seekg(size,std::ios::cur);
+        }
+    }
+
+template<class T>
+std::string
+snapshotBlob(T const& obj)
+    {
+    std::ostringstream ss(std::ios::binary);
+    write(ss,obj);
+    return ss.str();
+    }
+
+template<class Tensor>
+void
+writeSnapshot(std::string const& fname,
+              MPSt<Tensor> const& psi,
+              Args const& args)
+    {
+    auto compress = args.getBool("Compress",true);
+    auto indexed = args.getBool("Index",true);
+    auto N = psi.N();
+
+    std::ofstream f(fname,std::ios::binary);
+    if(!f) Error("Could not open snapshot file " + fname + " for writing");
+
+    uint32_t flags = 0;
+    if(compress) flags |= snapshot_compressed;
+    if(indexed) flags |= snapshot_indexed;
+
+    f.write(snapshot_magic,8);
+    snapWrite<uint32_t>(f,snapshot_version);
+    snapWrite<uint32_t>(f,flags);
+    snapWrite<int32_t>(f,N);
+    snapWrite<int32_t>(f,psi.leftLim());
+    snapWrite<int32_t>(f,psi.rightLim());
+    snapWrite<double>(f,args.getReal("Beta",0.));
+    snapWrite<int64_t>(f,args.getInt("Step",0));
+
+    auto offsets = std::vector<uint64_t>(N+1);
+
+    std::ostringstream ss(std::ios::binary);
+    psi.sites().write(ss);
+    offsets.at(0) = f.tellp();
+    writeSnapshotBlob(f,ss.str(),compress);
+
+    for(int n = 1; n <= N; ++n)
+        {
+        offsets.at(n) = f.tellp();
+        writeSnapshotBlob(f,snapshotBlob(psi.A(n)),compress);
+        }
+
+    if(indexed)
+        {
+        uint64_t index_pos = f.tellp();
+        for(auto o : offsets) snapWrite<uint64_t>(f,o);
+        snapWrite<uint64_t>(f,index_pos);
+        }
+
+    if(!f) Error("Error writing snapshot file " + fname);
+    }
+
+SnapshotInfo inline
+readSnapshotInfo(std::string const& fname)
+    {
+    std::ifstream f(fname,std::ios::binary);
+    if(!f) Error("Could not open snapshot file " + fname);
+    return readSnapshotHeader(f);
+    }
+
+template<class SiteSetT>
+SiteSetT
+readSnapshotSites(std::string const& fname)
+    {
+    std::ifstream f(fname,std::ios::binary);
+    if(!f) Error("Could not open snapshot file " + fname);
+    auto info = readSnapshotHeader(f);
+    std::istringstream ss(readSnapshotBlob(f,info.compressed),std::ios::binary);
+    auto sites = SiteSetT();
+    sites.read(ss);
+    return sites;
+    }
+
+template<class Tensor>
+MPSt<Tensor>
+readSnapshot(std::string const& fname,
+             SiteSet const& sites,
+             SnapshotInfo* pinfo)
+    {
+    std::ifstream f(fname,std::ios::binary);
+    if(!f) Error("Could not open snapshot file " + fname);
+    auto info = readSnapshotHeader(f);
+    if(pinfo) *pinfo = info;
+    if(info.N != sites.N()) Error("Snapshot " + fname + " does not match site set");
+
+    //Skip the stored site set
+    seekSnapshotBlob(f,info,1);
+
+    auto psi = MPSt<Tensor>(sites);
+    for(int n = 1; n <= info.N; ++n)
+        {
+        std::istringstream ss(readSnapshotBlob(f,info.compressed),std::ios::binary);
+        read(ss,psi.Aref(n));
+        }
+    if(!hasindex(psi.A(1),sites(1))) Error("Snapshot " + fname + " does not match site set");
+    psi.leftLim(info.llim);
+    psi.rightLim(info.rlim);
+
+    return psi;
+    }
+
+template<class Tensor>
+Tensor
+readSnapshotSite(std::string const& fname,
+                 int n)
+    {
+    std::ifstream f(fname,std::ios::binary);
+    if(!f) Error("Could not open snapshot file " + fname);
+    auto info = readSnapshotHeader(f);
+    if(n < 1 || n > info.N) Error("Site number out of range in readSnapshotSite");
+
+    seekSnapshotBlob(f,info,n);
+    std::istringstream ss(readSnapshotBlob(f,info.compressed),std::ios::binary);
+    Tensor T;
+    read(ss,T);
+    return T;
+    }
+
+} //namespace itensor
+
+#endif //__SNAPSHOT_H
@@ -0,0 +1,137 @@
+#ifndef __THREADPOOL_H
+#define __THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace itensor {
+
+//
+// Fixed set of worker threads, started once and reused for every
+// batch of tasks, so repeated parallel steps do not pay for
+// creating and joining threads each time.
+//
+// run(ntasks,f) calls f(i) for i = 0..ntasks-1 on the workers
+// and returns once all calls are done. A pool of 0 threads runs
+// the tasks on the calling thread.
+//
+class ThreadPool
+    {
+    public:
+
+    explicit
+    ThreadPool(int nthreads);
+
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    int
+    size() const { return threads_.size(); }
+
+    void
+    run(int ntasks,
+        std::function<void(int)> f);
+
+    private:
+
+    void
+    work();
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable start_,
+                            done_;
+    std::function<void(int)> task_;
+    int ntasks_ = 0,
+        next_ = 0,
+        pending_ = 0;
+    long generation_ = 0;
+    bool stop_ = false;
+    };
+
+//
+// Mutex held while ITensor creates new indices from worker threads:
+// the index id generator of ITensor is not thread safe
+//
+inline std::mutex&
+indexMutex()
+    {
+    static std::mutex m;
+    return m;
+    }
+
+
+//
+// Implementations
+//
+
+inline ThreadPool::
+ThreadPool(int nthreads)
+    {
+    for(int n = 0; n < nthreads; ++n)
+        {
+        threads_.emplace_back([this]() { work(); });
+        }
+    }
+
+inline ThreadPool::
+~ThreadPool()
+    {
+        {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        }
+    start_.notify_all();
+    for(auto& t : threads_) t.join();
+    }
+
+inline void ThreadPool::
+run(int ntasks,
+    std::function<void(int)> f)
+    {
+    if(ntasks <= 0) return;
+    if(threads_.empty())
+        {
+        for(int i = 0; i < ntasks; ++i) f(i);
+        return;
+        }
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = std::move(f);
+    ntasks_ = ntasks;
+    next_ = 0;
+    pending_ = ntasks;
+    ++generation_;
+    start_.notify_all();
+    done_.wait(lock,[this]() { return pending_ == 0; });
+    task_ = nullptr;
+    }
+
+inline void ThreadPool::
+work()
+    {
+    long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true)
+        {
+        start_.wait(lock,[this,&seen]() { return stop_ || generation_ != seen; });
+        if(stop_) return;
+        seen = generation_;
+        while(next_ < ntasks_)
+            {
+            auto i = next_++;
+            lock.unlock();
+            task_(i);
+            lock.lock();
+            if(--pending_ == 0) done_.notify_all();
+            }
+        }
+    }
+
+} //namespace itensor
+
+#endif //__THREADPOOL_H
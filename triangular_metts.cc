@@ -1,3 +1,4 @@
+#include <functional>
 #include "itensor/all.h"
 #include "basis/rotatexz.h"
 #include "heisops.h"
@@ -5,7 +6,15 @@
 #include "collapse.h"
 #include "S2.h"
 #include "trotter.h"
+#include "parallel_tevol.h"
+#include "gate_kernel.h"
 #include "TStateObserver.h"
+#include "metts.h"
+#include "inputlist.h"
+#include "artifact_cache.h"
+#include "mempool.h"
+#include "mpo_tevol.h"
+#include "memgovernor.h"
 
 using namespace std;
 using namespace itensor;
@@ -26,7 +35,9 @@ main(int argc, char* argv[])
 
     auto Nx = in.getInt("Nx");
     auto Ny = in.getInt("Ny");
-    auto beta = in.getReal("beta");
+    auto betas = parseRealList(in.getString("betas",""));
+    auto scan = !betas.empty();
+    if(!scan) betas = {in.getReal("beta")};
     auto cutoff = in.getReal("cutoff");
 
     auto hz = in.getReal("hz",0);
@@ -34,6 +45,24 @@ main(int argc, char* argv[])
     auto maxm = in.getInt("maxm",5000);
     auto tau = in.getReal("tau",0.1);
     auto nwarm = in.getInt("nwarm",5);
+    auto nwarm_scan = in.getInt("nwarm_scan",nwarm);
+    auto scan_file = in.getString("scan_file","metts_scan.dat");
+    auto init_psi = in.getString("init_psi","");
+    auto init_sites = in.getString("init_sites","sites");
+    auto evolver = in.getString("evolver","gates");
+    auto nthreads = in.getInt("nthreads",1);
+    auto measure_threads = in.getInt("measure_threads",1);
+    auto pipeline = in.getYesNo("pipeline",false);
+    auto fuse_collapse = in.getYesNo("fuse_collapse",true);
+    auto snapshot_every = in.getInt("snapshot_every",0);
+    auto cache_dir = in.getString("cache_dir","");
+    auto mempool = in.getYesNo("mempool",false);
+    auto pool_top_pad = in.getReal("pool_top_pad",64);
+    auto pool_max = in.getReal("pool_max",4096);
+    auto realstep = in.getYesNo("realstep",false);
+    auto memory_budget = in.getReal("memory_budget",0.);
+    auto svd_method = in.getString("svd_method","full");
+
     
     Real Jxy = 1;
     Real Jz = 1;
@@ -42,7 +71,11 @@ main(int argc, char* argv[])
 
     auto N = Nx*Ny;
 
-    auto sites = SpinHalf(N);
+    //Everything built at startup may be taken from the artifact
+    //cache. The site set comes from the cache too, so that cached
+    //operators of different jobs share the same site indices.
+    auto cache = ArtifactCache(cache_dir);
+    auto sites = cache.sites<SpinHalf>(format("SpinHalf N=%d",N),[N]() { return SpinHalf(N); });
         
     auto basis = rotateXZ<IQTensor>(sites);
         
@@ -57,6 +90,13 @@ main(int argc, char* argv[])
     args.add("Jz",Jz);
     args.add("hz",hz);
     args.add("hx",0.);
+    args.add("Pipeline",pipeline);
+    args.add("MemoryPool",mempool);
+    args.add("PoolTopPad",pool_top_pad);
+    args.add("PoolMaxMB",pool_max);
+    args.add("FuseCollapse",fuse_collapse);
+    args.add("MeasureThreads",measure_threads);
+    args.add("SnapshotEvery",snapshot_every);
 
     Print(args);
 
@@ -84,17 +124,21 @@ main(int argc, char* argv[])
             }
         }
     
-    auto H = IQMPO(ampo);
-    
-    IQMPO H2;
-    nmultMPO(H,H,H2,"Cutoff=1E-12,Maxm=200");
+    auto hdesc = format("%s Nx=%d Ny=%d YPeriodic=1 Jxy=%.17g Jz=%.17g hz=%.17g",
+                        lattice_type,Nx,Ny,Jxy,Jz,hz);
+
+    auto mpos = METTSMPOs();
+    mpos.H = cache.mpo<IQMPO>("H "+hdesc,sites,[&ampo]() { return IQMPO(ampo); });
+    mpos.H2 = cache.mpo<IQMPO>("H2 Cutoff=1E-12 Maxm=200 "+hdesc,sites,[&mpos]()
+        {
+        auto H2 = IQMPO();
+        nmultMPO(mpos.H,mpos.H,H2,"Cutoff=1E-12,Maxm=200");
+        return H2;
+        });
         
-    IQMPO S2 = makeS2(sites);
-    IQMPO Sxy2 = makeSxy2(sites);
-    IQMPO Sz2 = makeTotSz2(sites);
-  
-    auto ops = HeisOps(sites,Nx,Ny,args);
-    auto gates = makeGates<IQTensor>(sites,lattice,tau,ops);
+    mpos.S2 = cache.mpo<IQMPO>(format("S2 N=%d",N),sites,[&sites]() { return makeS2(sites); });
+    mpos.Sxy2 = cache.mpo<IQMPO>(format("Sxy2 N=%d",N),sites,[&sites]() { return makeSxy2(sites); });
+    mpos.Sz2 = cache.mpo<IQMPO>(format("Sz2 N=%d",N),sites,[&sites]() { return makeTotSz2(sites); });
 
     auto state = InitState(sites,"Up");
     for (int i = 1; i <= Nx; ++i)
@@ -108,112 +152,160 @@ main(int argc, char* argv[])
 
     auto psi = IQMPS(state);
 
-    //observables
-    bool verbose = true;
-    Stats en_stat,
-          magz_stat,
-          magz2_stat,
-          en2_stat,
-          s2_stat,
-          sxy2_stat,
-          z2_stat,
-          cpu_stat;
-        
+    if(init_psi != "")
+        {
+        //Start from a product state sampled from
+        //a purified state made by mpo_ancilla
+        auto asites = SpinHalf();
+        readFromFile(init_sites,asites);
+        auto apsi = IQMPS(asites);
+        readFromFile(init_psi,apsi);
+        if(apsi.N() != 2*N) Error("Purified state in init_psi must have 2*Nx*Ny sites");
+
+        auto st = samplePurified(apsi,rotateXZ<IQTensor>(asites),args);
+        setProductState(psi,basis,st,args);
+        print("Initial state sampled from ",init_psi,": ");
+        for(int j = 1; j <= N; ++j)
+            {
+            print(basis->statestr(j,st[j],args)," ");
+            }
+        println();
+        }
+
     Args targs;
     targs.add("Verbose",false);
     targs.add("Maxm",maxm);
     targs.add("Minm",6);
     targs.add("Cutoff",cutoff);
+    targs.add("Segments",nthreads);
+    targs.add("SVDMethod",svd_method);
+    targs.add("RSVDOversample",in.getInt("rsvd_oversample",10));
+    targs.add("RSVDPower",in.getInt("rsvd_power",1));
         
     auto obs = TStateObserver<IQTensor>(psi);
 
-    for(int step = 1; step <= (nwarm+nmetts); ++step)
+    //Gates are built once for each distinct time step,
+    //sharing the gate exponentials through gate_cache
+    auto gate_cache = GateCache<IQTensor>(sites);
+    std::map<Real,GateList<IQTensor>> gates_by_tau;
+    std::map<Real,std::vector<GateGroup<IQTensor>>> groups_by_tau;
+    std::map<Real,ExpH<IQTensor>> expH_by_tau;
+
+    std::ofstream scanfile;
+    if(scan)
         {
-        psi.position(1);
-        args.add("Step",step);
+        scanfile.open(scan_file);
+        scanfile << "# beta E/N err C/N err chi/N err chi_xy/N err nmetts\n";
+        }
 
-        if(verbose)
-            {
-            if (step <= nwarm) 
-                printfln("\nStarting step %d (warmup %d/%d)",step,step,nwarm);
-            else
-                printfln("\nMaking METTS number %d/%d",step-nwarm,nmetts);
-            }
+    //Memory in use before any METTS is made, the baseline of the
+    //memory governor: taken once the first gates or exp(-tau H)
+    //are made, before the first evolution
+    Real baseline_rss = -1;
 
-        println("Doing regular gateTEvol");
-        auto cpu_time_1s = cpu_mytime();
-        gateTEvol(gates,beta/2.,tau,psi,obs,targs);
-        auto cpu_time_1e = cpu_mytime();
-        printfln("CPU time for generation of METTS %.14f",cpu_time_1e - cpu_time_1s);
+    for(auto n : range(betas))
+        {
+        auto beta = betas.at(n);
 
+        //Adjust tau so that it divides beta/2
+        auto nt = std::max(1,int(std::ceil(beta/(2*tau)-1E-9)));
+        auto tau_b = beta/(2.*nt);
 
-        if(step > nwarm) println("\nDone making METTS ",step-nwarm);
-        int maxmm = 0;
-        for(int b = 0; b < psi.N(); ++b)
+        auto evolve = std::function<void(IQMPS&)>();
+        if(evolver == "gates" || evolver == "fast")
             {
-            int m_b = linkInd(psi,b).m();
-            maxmm = std::max(maxmm,m_b);
+            if(!gates_by_tau.count(tau_b))
+                {
+                auto gdesc = format("gates tau=%.17g hx=0 %s",tau_b,hdesc);
+                gates_by_tau[tau_b] = cache.gates<IQTensor>(gdesc,sites,[&]()
+                    {
+                    return makeGates<IQTensor>(sites,lattice,tau_b,HeisOps(sites,Nx,Ny,args),gate_cache);
+                    });
+                }
+            if(evolver == "fast")
+                {
+                evolve = [&gates_by_tau,&obs,&targs,beta,tau_b](IQMPS& psi)
+                    {
+                    println("Doing fastGateTEvol");
+                    fastGateTEvol(gates_by_tau.at(tau_b),beta/2.,tau_b,psi,obs,targs);
+                    };
+                }
+            else
+                {
+                evolve = [&gates_by_tau,&obs,&targs,beta,tau_b](IQMPS& psi)
+                    {
+                    println("Doing regular gateTEvol");
+                    gateTEvol(gates_by_tau.at(tau_b),beta/2.,tau_b,psi,obs,targs);
+                    };
+                }
             }
-            
-        if(step > nwarm)
+        else if(evolver == "parallel")
             {
-            //
-            //CPU time
-            //
-            cpu_stat.putin(cpu_time_1e-cpu_time_1s);
-            printfln("Average CPU time = %.14f %.3E",cpu_stat.avg(),cpu_stat.err());
-            
-            //
-            //Energy
-            //
-            const auto en = psiHphi(psi,H,psi);
-            en_stat.putin(en);
-            auto avgEn = en_stat.avg();
-            printfln("Energy of METTS %d = %.14f",step-nwarm,en);
-            printfln("Average energy = %.14f %.3E",avgEn,en_stat.err());
-            printfln("Average energy per site = %.14f %.3E",avgEn/N,en_stat.err()/N);
-            
-            //
-            //Specific heat
-            //
-            const auto en2 = psiHphi(psi,H2,psi);
-            en2_stat.putin(en2);
-            auto avgEn2 = en2_stat.avg();
-            printfln("<H^2> for METTS %d = %.14f",step-nwarm,en2);
-            printfln("Average specific heat = %.14f %.3E",(avgEn2-sqr(avgEn))*sqr(beta),en2_stat.err());
-            printfln("Average specific heat per site = %.14f %.3E",(avgEn2-sqr(avgEn))*sqr(beta)/N,en2_stat.err()/N);
-            
-            //
-            //Susceptibility
-            //
-            const auto s2val = overlap(psi,S2,psi);
-            s2_stat.putin(s2val);
-            auto asus = (s2_stat.avg()*beta/3);
-            auto esus = (s2_stat.err()*beta/3);
-            printfln("<S^2> for METTS %d = %.14f",step-nwarm,s2val);
-            printfln("Average total susceptibility = %.14f %.3E",asus,esus);
-            printfln("Average total susceptibility per site = %.14f %.3E (%.5f,%.5f)",
-                     asus/N,esus/N,(asus-esus)/N,(asus+esus)/N);
-
-            const auto sxy2val = overlap(psi,Sxy2,psi);
-            sxy2_stat.putin(sxy2val);
-            asus = (sxy2_stat.avg()*beta/2);
-            esus = (sxy2_stat.err()*beta/2);
-            printfln("<(Sx^2+Sy^2)> for METTS %d = %.14f",step-nwarm,sxy2val);
-            printfln("Average total XY susceptibility = %.14f %.3E",asus,esus);
-            printfln("Average total XY susceptibility per site = %.14f %.3E (%.5f,%.5f)",
-                     asus/N,esus/N,(asus-esus)/N,(asus+esus)/N);
-
-
+            if(!groups_by_tau.count(tau_b))
+                {
+                groups_by_tau[tau_b] = makeGateGroups<IQTensor>(sites,lattice,tau_b,HeisOps(sites,Nx,Ny,args),gate_cache);
+                }
+            evolve = [&groups_by_tau,&obs,&targs,beta,tau_b,nthreads](IQMPS& psi)
+                {
+                printfln("Doing parallel gateTEvol on %d threads",nthreads);
+                parallelGateTEvol(groups_by_tau.at(tau_b),beta/2.,tau_b,psi,obs,targs);
+                };
+            }
+        else if(evolver == "mpo")
+            {
+            if(!expH_by_tau.count(tau_b))
+                {
+                expH_by_tau[tau_b] = makeExpH<IQTensor>(ampo,tau_b,cache,hdesc,{"RealStep",realstep});
+                }
+            evolve = [&expH_by_tau,&obs,&targs,beta,tau_b](IQMPS& psi)
+                {
+                println("Doing mpoTEvol");
+                mpoTEvol(expH_by_tau.at(tau_b),beta/2.,tau_b,psi,obs,targs);
+                };
+            }
+        else
+            {
+            Error("evolver must be gates, fast, parallel or mpo");
             }
 
-        // Collapse into product state
-        auto cps = collapse(psi,basis,args);
-        for(int j = 1; j <= N; ++j)
+        if(memory_budget > 0)
             {
-            print(basis->statestr(j,cps[j],args)," ");
+            //Cap maxm for the whole evolution if needed, and print
+            //the weight this discards: the evolvers which do not pass
+            //"TruncErr" to the observer get a sweep of psi instead
+            if(baseline_rss < 0) baseline_rss = memoryUsage().rss;
+            auto gargs = targs;
+            gargs.add("Maxm",maxm);
+            gargs.add("Baseline",baseline_rss);
+            if(evolver == "mpo")
+                {
+                gargs.add("MPOLinkDim",maxLinkDim(expH_by_tau.at(tau_b)));
+                gargs.add("Complex",!realstep);
+                }
+            auto governor = MemoryGovernor(memory_budget,gargs);
+            auto evolve_psi = evolve;
+            evolve = [governor,evolve_psi,&obs,&targs](IQMPS& psi) mutable
+                {
+                governor.limit(psi,targs);
+                obs.resetTruncErr();
+                evolve_psi(psi);
+                if(obs.truncErrSteps() > 0) governor.report(obs.truncErr());
+                else                        governor.reportKept(psi);
+                };
             }
-        println();
+
+        printfln("Gate cache holds %d distinct gates",gate_cache.size());
+
+        if(scan) printfln("\nStarting chain at beta = %.10f (tau = %.10f)",beta,tau_b);
+
+        //Chains after the first start from the last
+        //product state of the previous temperature
+        auto nw = (n == 0 ? nwarm : nwarm_scan);
+
+        auto stats = METTSStats();
+        runMETTS(psi,evolve,mpos,basis,beta,nw,nmetts,stats,args);
+
+        if(scan) writeStats(scanfile,beta,N,nmetts,stats);
         }
 
     return 0;
@@ -2,13 +2,37 @@
 #define __TROTTER_H
 
 #include <list>
+#include <vector>
 #include "itensor/mps/bondgate.h"
+#include "gatecache.h"
 
 namespace itensor {
 
 template <typename Tensor>
 using GateList = std::list<BondGate<Tensor>>;
 
+//
+// The gates making up a single bond term: the bond
+// gate together with the swap gates bringing its two
+// sites next to each other and back. first and last
+// are the first and last sites the gates act on.
+//
+template <typename Tensor>
+struct GateGroup
+    {
+    int first = 0,
+        last = 0;
+    GateList<Tensor> gates;
+    };
+
+template<class Tensor,class BondContainer,class OpFunction>
+std::vector<GateGroup<Tensor>>
+makeGateGroups(const SiteSet& sites,
+               const BondContainer& bonds,
+               Real tau,
+               OpFunction&& opf,
+               const Args& args = Global::args());
+
 template<class Tensor,class BondContainer,class OpFunction>
 GateList<Tensor>
 makeGates(const SiteSet& sites,
@@ -17,6 +41,29 @@ makeGates(const SiteSet& sites,
           OpFunction&& opf,
           const Args& args = Global::args());
 
+//
+// Versions taking a GateCache, which can be shared between
+// calls for different time steps or different chains so that
+// each distinct gate exponential is only computed once
+//
+template<class Tensor,class BondContainer,class OpFunction>
+std::vector<GateGroup<Tensor>>
+makeGateGroups(const SiteSet& sites,
+               const BondContainer& bonds,
+               Real tau,
+               OpFunction&& opf,
+               GateCache<Tensor>& cache,
+               const Args& args = Global::args());
+
+template<class Tensor,class BondContainer,class OpFunction>
+GateList<Tensor>
+makeGates(const SiteSet& sites,
+          const BondContainer& bonds,
+          Real tau,
+          OpFunction&& opf,
+          GateCache<Tensor>& cache,
+          const Args& args = Global::args());
+
 template <typename GateT>
 void
 cleanGates(std::list<GateT>& gates);
@@ -27,18 +74,31 @@ cleanGates(std::list<GateT>& gates);
 //
 
 template<class Tensor,class BondContainer,class OpFunction>
-GateList<Tensor>
-makeGates(SiteSet const& sites,
-          BondContainer const& bonds,
-          Real tau,
-          OpFunction && opf,
-          Args const& args)
+std::vector<GateGroup<Tensor>>
+makeGateGroups(SiteSet const& sites,
+               BondContainer const& bonds,
+               Real tau,
+               OpFunction && opf,
+               Args const& args)
+    {
+    auto cache = GateCache<Tensor>(sites);
+    return makeGateGroups<Tensor>(sites,bonds,tau,opf,cache,args);
+    }
+
+template<class Tensor,class BondContainer,class OpFunction>
+std::vector<GateGroup<Tensor>>
+makeGateGroups(SiteSet const& sites,
+               BondContainer const& bonds,
+               Real tau,
+               OpFunction && opf,
+               GateCache<Tensor>& cache,
+               Args const& args)
     {
     using GateT = BondGate<Tensor>;
 
     auto ancilla_mode = args.getBool("Ancilla",false);
 
-    GateList<Tensor> gates;
+    std::vector<GateGroup<Tensor>> groups;
 
     for(const auto& b : bonds)
         {
@@ -54,9 +114,15 @@ makeGates(SiteSet const& sites,
 
         if(norm(hh) < 1E-12) continue;
 
+        groups.emplace_back();
+        auto& group = groups.back();
+        group.first = i1;
+        group.last = i2;
+        auto& gates = group.gates;
+
         if(abs(i2-i1) == 1)
             {
-            gates.push_back(GateT(sites,i1,i2,GateT::tImag,tau/2.,hh));
+            gates.push_back(cache.gate(i1,i2,tau/2.,hh,b.type));
             }
         else
             {
@@ -76,7 +142,7 @@ makeGates(SiteSet const& sites,
             hh *= II;
             hh *= dag(prime(II));
 
-            gates.push_back(GateT(sites,i2-1,i2,GateT::tImag,tau/2.,hh));
+            gates.push_back(cache.gate(i2-1,i2,tau/2.,hh,b.type));
 
             //Swap gates
             for(int k1 = i2-2; k1 >= i1; --k1) 
@@ -86,6 +152,38 @@ makeGates(SiteSet const& sites,
             }
         }
 
+    return groups;
+    }
+
+template<class Tensor,class BondContainer,class OpFunction>
+GateList<Tensor>
+makeGates(SiteSet const& sites,
+          BondContainer const& bonds,
+          Real tau,
+          OpFunction && opf,
+          Args const& args)
+    {
+    auto cache = GateCache<Tensor>(sites);
+    return makeGates<Tensor>(sites,bonds,tau,opf,cache,args);
+    }
+
+template<class Tensor,class BondContainer,class OpFunction>
+GateList<Tensor>
+makeGates(SiteSet const& sites,
+          BondContainer const& bonds,
+          Real tau,
+          OpFunction && opf,
+          GateCache<Tensor>& cache,
+          Args const& args)
+    {
+    GateList<Tensor> gates;
+
+    auto groups = makeGateGroups<Tensor>(sites,bonds,tau,opf,cache,args);
+    for(auto& g : groups)
+        {
+        gates.splice(gates.end(),g.gates);
+        }
+
     // include b1.b2.b3....b3.b2.b1, second order trotter decomposition
 
     GateList<Tensor> gates2(gates);